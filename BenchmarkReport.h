@@ -0,0 +1,148 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+Timing and reporting shared by LexpBenchmark and LimpBenchmark (the two languages cannot be
+linked into one program). Every measurement is one result named "workload/metric", with its
+unit and whether lower or higher values are better. The report is printed as JSON with one
+result per line, so two runs can be diffed as text or compared with --compare.
+*/
+
+struct BenchmarkOptions {
+    double scale = 1.0;       // multiplies the size of every generated workload
+    string compareWith;       // a report of an earlier run
+    double threshold = 10.0;  // percent a result may get worse before it counts as a regression
+};
+
+// Reads --scale=F, --compare=FILE and --threshold=PERCENT; exits with a usage line on anything else
+inline BenchmarkOptions parseBenchmarkOptions(int argc, char *argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--scale=", 0) == 0) {
+            options.scale = atof(arg.c_str() + strlen("--scale="));
+        } else if (arg.rfind("--compare=", 0) == 0) {
+            options.compareWith = arg.substr(strlen("--compare="));
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            options.threshold = atof(arg.c_str() + strlen("--threshold="));
+        } else {
+            cerr << "Usage: " << argv[0] << " [--scale=F] [--compare=previous.json] [--threshold=PERCENT]" << endl;
+            exit(1);
+        }
+    }
+    if (options.scale <= 0) {
+        options.scale = 1.0;
+    }
+    return options;
+}
+
+/*
+Runs body callsPerBatch times in each of batches batches and returns the time of one call in
+nanoseconds, from the fastest batch: the other batches only add noise from the rest of the machine.
+*/
+inline double measureNanoseconds(int batches, int callsPerBatch, const function<void()>& body) {
+    double best = HUGE_VAL;
+    for (int batch = 0; batch < max(batches, 1); batch++) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < callsPerBatch; i++) {
+            body();
+        }
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count() / max(callsPerBatch, 1));
+    }
+    return best;
+}
+
+class BenchmarkReport {
+    public:
+        BenchmarkReport(const string& suite, double scale) : suite(suite), scale(scale) {}
+
+        void add(const string& name, double value, const string& unit, bool lowerIsBetter) {
+            results.push_back(Result{name, value, unit, lowerIsBetter});
+            // a line per result on the console as the run goes, the JSON comes at the end
+            cerr << left << setw(44) << name << " " << setprecision(4) << value << " " << unit << endl;
+        }
+
+        void writeJson(ostream& out) const {
+            out << "{\n";
+            out << "  \"suite\": \"" << suite << "\",\n";
+            out << "  \"scale\": " << scale << ",\n";
+            out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+            out << "  \"results\": [\n";
+            for (size_t i = 0; i < results.size(); i++) {
+                const Result& r = results[i];
+                out << "    {\"name\": \"" << r.name << "\", \"value\": " << setprecision(6) << r.value
+                    << ", \"unit\": \"" << r.unit << "\", \"better\": \"" << (r.lowerIsBetter ? "lower" : "higher")
+                    << "\"}" << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n";
+            out << "}\n";
+        }
+
+        /*
+        Compares the results with those of the report in path (as written by writeJson) and prints
+        one line per result both runs have. Returns how many got worse by more than threshold percent.
+        */
+        int compare(const string& path, double threshold, ostream& log) const {
+            ifstream file(path);
+            if (!file.is_open()) {
+                log << "Cannot open " << path << endl;
+                return 1;
+            }
+            map<string, double> previous;
+            string line;
+            while (getline(file, line)) {
+                size_t name = line.find("\"name\": \"");
+                size_t value = line.find("\"value\": ");
+                if (name == string::npos || value == string::npos) {
+                    continue;
+                }
+                name += strlen("\"name\": \"");
+                previous[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + value + strlen("\"value\": "));
+            }
+
+            int regressions = 0;
+            for (const Result& r : results) {
+                auto found = previous.find(r.name);
+                if (found == previous.end() || found->second == 0) {
+                    continue;
+                }
+                double change = (r.value - found->second) / found->second * 100;
+                bool worse = r.lowerIsBetter ? change > threshold : change < -threshold;
+                regressions += worse;
+                log << left << setw(44) << r.name << " " << setprecision(4) << found->second << " -> " << r.value
+                    << " " << r.unit << " (" << showpos << fixed << setprecision(1) << change << "%)"
+                    << noshowpos << defaultfloat << (worse ? "  REGRESSION" : "") << endl;
+            }
+            return regressions;
+        }
+
+    private:
+        struct Result {
+            string name;
+            double value;
+            string unit;
+            bool lowerIsBetter;
+        };
+
+        string suite;
+        double scale;
+        vector<Result> results;
+};
+
+#endif
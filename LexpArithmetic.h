@@ -0,0 +1,37 @@
+#ifndef LEXP_ARITHMETIC_H
+#define LEXP_ARITHMETIC_H
+
+#include <cstdint>
+#include <stdexcept>
+
+/*
+Lexp's integer operators, shared by the evaluator and the constant folder.
+Overflow wraps around; doing the arithmetic on uint32_t keeps that well defined.
+*/
+
+inline int lexpAdd(int left, int right) {
+    return (int)((uint32_t)left + (uint32_t)right);
+}
+
+// A negative difference is clamped to 0
+inline int lexpSubtract(int left, int right) {
+    int result = (int)((uint32_t)left - (uint32_t)right);
+    return result < 0 ? 0 : result;
+}
+
+inline int lexpMultiply(int left, int right) {
+    return (int)((uint32_t)left * (uint32_t)right);
+}
+
+// Truncating division; INT_MIN / -1 wraps instead of trapping
+inline int lexpDivide(int left, int right) {
+    if (right == 0) {
+        throw std::runtime_error("Division by zero");
+    }
+    if (right == -1) {
+        return (int)(0u - (uint32_t)left);
+    }
+    return left / right;
+}
+
+#endif
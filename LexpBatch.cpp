@@ -0,0 +1,277 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Batch mode for Lexp
+Description: This module runs the Lexp interpreter over large files of independent expression
+             lines on several threads. The input is memory-mapped instead of read line by line,
+             and a reorder buffer keeps the output in the order of the input lines.
+             It also runs the interpreter over a stream of lines that keeps arriving on a pipe,
+             reading and writing in large blocks.
+*/
+
+#include "LexpBatch.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0) {
+        size = (size_t)info.st_size;
+        if (size == 0) {
+            opened = true; // mmap refuses empty mappings, an empty view will do
+        } else {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                madvise(mapped, size, MADV_SEQUENTIAL);
+                data = (const char*)mapped;
+                opened = true;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap((void*)data, size);
+    }
+}
+
+// Cuts text into pieces of about chunkSize bytes that each end at a '\n' (or the end of the text)
+static vector<string_view> splitIntoChunks(string_view text, size_t chunkSize) {
+    vector<string_view> chunks;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = min(start + chunkSize, text.size());
+        if (end < text.size()) {
+            size_t newline = text.find('\n', end);
+            end = newline == string_view::npos ? text.size() : newline + 1;
+        }
+        chunks.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+size_t processLinesInParallel(string_view text, unsigned threads,
+                              const function<bool(string_view line, ostream& out)>& processLine, ostream& out) {
+    threads = max(threads, 1u);
+    // several chunks per thread so one slow chunk does not leave the others idle
+    size_t chunkSize = clamp(text.size() / (threads * 16), (size_t)64 * 1024, (size_t)4 * 1024 * 1024);
+    vector<string_view> chunks = splitIntoChunks(text, chunkSize);
+
+    struct ChunkResult {
+        string output;
+        size_t failures = 0;
+        bool ready = false;
+    };
+    vector<ChunkResult> results(chunks.size());
+    const size_t window = threads * 4; // chunks that may be done but not yet written
+
+    mutex lock;
+    condition_variable chunkReady;
+    condition_variable windowMoved;
+    size_t nextChunk = 0;
+    size_t written = 0;
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t index;
+            {
+                unique_lock<mutex> guard(lock);
+                windowMoved.wait(guard, [&] { return nextChunk >= chunks.size() || nextChunk < written + window; });
+                if (nextChunk >= chunks.size()) {
+                    return;
+                }
+                index = nextChunk++;
+            }
+
+            ostringstream buffer;
+            size_t failures = 0;
+            string_view chunk = chunks[index];
+            size_t start = 0;
+            while (start < chunk.size()) {
+                size_t end = chunk.find('\n', start);
+                if (end == string_view::npos) {
+                    end = chunk.size();
+                }
+                if (!processLine(chunk.substr(start, end - start), buffer)) {
+                    failures++;
+                }
+                start = end + 1;
+            }
+
+            {
+                lock_guard<mutex> guard(lock);
+                results[index].output = buffer.str();
+                results[index].failures = failures;
+                results[index].ready = true;
+            }
+            chunkReady.notify_one();
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned i = 0; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+
+    size_t failures = 0;
+    for (size_t index = 0; index < chunks.size(); index++) {
+        string output;
+        {
+            unique_lock<mutex> guard(lock);
+            chunkReady.wait(guard, [&] { return results[index].ready; });
+            output = std::move(results[index].output);
+            failures += results[index].failures;
+        }
+        out.write(output.data(), (streamsize)output.size());
+        {
+            lock_guard<mutex> guard(lock);
+            written = index + 1;
+        }
+        windowMoved.notify_all();
+    }
+
+    for (thread& t : pool) {
+        t.join();
+    }
+    return failures;
+}
+
+// The buffer behind the ostream processLineStream prints into, written to a file descriptor
+class DescriptorBuffer : public streambuf {
+    public:
+        DescriptorBuffer(int fd, size_t capacity) : fd(fd), buffer(capacity) {
+            setp(buffer.data(), buffer.data() + buffer.size());
+        }
+
+        size_t pending() const { return (size_t)(pptr() - pbase()); }
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!writeOut()) {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override { return writeOut() ? 0 : -1; }
+
+        // only tellp, which is asked for the bytes printed so far
+        pos_type seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode which) override {
+            if (offset != 0 || direction != ios_base::cur || !(which & ios_base::out)) {
+                return pos_type(off_type(-1));
+            }
+            return pos_type(off_type(written + pending()));
+        }
+
+    private:
+        int fd;
+        vector<char> buffer;
+        size_t written = 0;
+
+        // false when the descriptor no longer takes output (the reader went away)
+        bool writeOut() {
+            const char* data = pbase();
+            size_t left = pending();
+            while (left > 0) {
+                ssize_t count = write(fd, data, left);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                data += count;
+                left -= (size_t)count;
+            }
+            written += pending();
+            setp(buffer.data(), buffer.data() + buffer.size());
+            return true;
+        }
+};
+
+size_t processLineStream(int inputFd, int outputFd, int flushMilliseconds,
+                         const function<bool(string_view line, ostream& out)>& processLine) {
+    const size_t blockSize = 1 << 20;
+    DescriptorBuffer outputBuffer(outputFd, blockSize);
+    ostream out(&outputBuffer);
+    vector<char> input(blockSize);
+    size_t kept = 0; // bytes at the start of input: a line whose end has not been read yet
+    size_t failures = 0;
+
+    const auto deadline = chrono::milliseconds(max(flushMilliseconds, 0));
+    auto lastFlush = chrono::steady_clock::now();
+    auto flush = [&]() {
+        out.flush();
+        lastFlush = chrono::steady_clock::now();
+    };
+
+    while (out) {
+        // the end of a batch: nothing more has arrived, so the answers go out before waiting for it
+        if (outputBuffer.pending() > 0) {
+            pollfd waiting{inputFd, POLLIN, 0};
+            if (poll(&waiting, 1, 0) == 0) {
+                flush();
+            }
+        }
+        if (kept == input.size()) {
+            input.resize(input.size() * 2); // a line longer than the buffer
+        }
+        ssize_t count = read(inputFd, input.data() + kept, input.size() - kept);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+
+        const char* text = input.data();
+        size_t end = kept + (size_t)count;
+        size_t start = 0;
+        size_t lines = 0;
+        while (const char* newline = (const char*)memchr(text + start, '\n', end - start)) {
+            size_t lineEnd = (size_t)(newline - text);
+            if (!processLine(string_view(text + start, lineEnd - start), out)) {
+                failures++;
+            }
+            start = lineEnd + 1;
+            // the clock is only read every few hundred lines, which takes well under a millisecond
+            if (++lines % 256 == 0 && outputBuffer.pending() > 0 && chrono::steady_clock::now() - lastFlush >= deadline) {
+                flush();
+            }
+        }
+        kept = end - start;
+        memmove(input.data(), text + start, kept);
+    }
+
+    // the last line, when the input does not end with a '\n'
+    if (kept > 0 && out && !processLine(string_view(input.data(), kept), out)) {
+        failures++;
+    }
+    out.flush();
+    return failures;
+}
@@ -0,0 +1,54 @@
+#ifndef LEXP_BATCH_H
+#define LEXP_BATCH_H
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <functional>
+#include <cstddef>
+
+using namespace std;
+
+// A whole input file mapped read-only into memory
+class MappedFile {
+    public:
+        explicit MappedFile(const string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool isOpen() const { return opened; }
+        string_view text() const { return string_view(data, size); }
+
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+        bool opened = false;
+};
+
+/*
+Calls processLine on every line of text (without its '\n') from a pool of threads
+and writes what each call printed to out, in the order of the lines.
+The text is cut into chunks of whole lines; a worker takes the next chunk and prints it
+into a buffer of its own, and the calling thread writes the buffers out as soon as all
+earlier chunks are written. Workers stay at most a few chunks ahead of the writer, so
+memory does not grow with the file.
+processLine returns false for a line that ended in an error; the count of those is returned.
+*/
+size_t processLinesInParallel(string_view text, unsigned threads,
+                              const function<bool(string_view line, ostream& out)>& processLine, ostream& out);
+
+/*
+Calls processLine on every line read from inputFd (a pipe, usually) until the input ends, and
+writes what the calls printed to outputFd. The input is read in large blocks and the output goes
+through one large buffer; only the block being read and the line that runs past its end are kept,
+so memory does not grow with the input. The output buffer is written when it is full, when every
+line that has arrived is answered and no more is waiting to be read (the end of a batch from the
+producer), and while lines keep arriving without a pause, once it has been flushMilliseconds since
+it was last written. out.tellp() is the number of bytes printed so far.
+processLine returns false for a line that ended in an error; the count of those is returned.
+*/
+size_t processLineStream(int inputFd, int outputFd, int flushMilliseconds,
+                         const function<bool(string_view line, ostream& out)>& processLine);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Benchmark for Lexp
+Description: This program generates synthetic Lexp workloads (one very long line, many short
+             lines, a deeply nested expression, a short expression evaluated over and over, and
+             columns of variable values) and measures each stage separately: scanner throughput
+             (scanLine), parser throughput (parseExpression), AST memory, and evaluation speed
+             of evaluateAST, of the postfix code and of the columnar evaluator.
+             The results are printed as JSON (see BenchmarkReport.h); --compare=FILE compares
+             them with an earlier run and exits with 1 when one got worse than --threshold.
+*/
+
+#include "LexpEvaluator.h"
+#include "LexpColumnar.h"
+#include "BenchmarkReport.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <random>
+
+using namespace std;
+
+// "1 + 2 * 3 - 4 / 5 + ..." with terms numbers, a long left-deep chain
+static string wideExpression(int terms) {
+    const char* operators[] = {" + ", " * ", " - ", " / "};
+    string text = "1";
+    for (int i = 1; i < terms; i++) {
+        text += operators[i % 4];
+        text += to_string(i % 97 + 1);
+    }
+    return text;
+}
+
+// "(1 + (2 * (3 + ...)))" nested depth levels deep
+static string deepExpression(int depth) {
+    string text;
+    for (int i = 0; i < depth; i++) {
+        text += "(" + to_string(i % 9 + 1) + (i % 2 ? " * " : " + ");
+    }
+    text += "1";
+    text += string(depth, ')');
+    return text;
+}
+
+// count random expressions of a few terms, some parenthesized, one per line, none dividing by zero
+static vector<string> shortLines(int count) {
+    const char* operators[] = {" + ", " - ", " * ", " / "};
+    mt19937 random(141);
+    vector<string> lines;
+    for (int i = 0; i < count; i++) {
+        int terms = 2 + random() % 6;
+        string text;
+        int open = 0;
+        for (int t = 0; t < terms; t++) {
+            if (t > 0) {
+                text += operators[random() % 4];
+            }
+            if (t + 1 < terms && random() % 4 == 0) {
+                text += "(";
+                open++;
+            }
+            text += to_string(random() % 1000 + 1);
+            if (open > 0 && random() % 3 == 0) {
+                text += ")";
+                open--;
+            }
+        }
+        text += string(open, ')');
+        TokenStream ts(scanLine(text));
+        AST ast;
+        ast.root = parseExpression(ts, ast);
+        try {
+            evaluateAST(ast, ast.root);
+            lines.push_back(text);
+        } catch (const exception&) {
+            i--;
+        }
+    }
+    return lines;
+}
+
+// Bytes held by the tree: the node arena, the interned spellings and their hash table
+static size_t astBytes(const AST& ast) {
+    size_t bytes = ast.nodes.capacity() * sizeof(ASTnode) + ast.nameTable.capacity() * sizeof(uint32_t);
+    for (const string& name : ast.names) {
+        bytes += sizeof(string) + (name.capacity() > 15 ? name.capacity() : 0);
+    }
+    return bytes;
+}
+
+static AST parseText(const string& text) {
+    TokenStream ts(scanLine(text));
+    AST ast;
+    ast.root = parseExpression(ts, ast);
+    return ast;
+}
+
+// Every stage on one expression, per node (or per token for the parser)
+static void benchmarkExpression(BenchmarkReport& report, const string& workload, const string& text, int batches) {
+    size_t tokenCount = scanLine(text).size();
+    AST ast = parseText(text);
+    double nodes = (double)ast.nodes.size();
+
+    PostfixCode program = compileExpression(ast);
+    if (evaluatePostfix(program) != evaluateAST(ast, ast.root)) {
+        cerr << workload << ": the postfix code and evaluateAST disagree" << endl;
+        exit(1);
+    }
+
+    volatile size_t sink = 0;
+    double scan = measureNanoseconds(batches, 1, [&]() { sink = scanLine(text).size(); });
+    double parse = measureNanoseconds(batches, 1, [&]() { sink = parseText(text).nodes.size(); });
+    double reduction = measureNanoseconds(batches, 1, [&]() { sink = evaluateAST(ast, ast.root); });
+    double compiled = measureNanoseconds(batches, 1, [&]() { sink = evaluatePostfix(compileExpression(ast)); });
+    double postfix = measureNanoseconds(batches, 1, [&]() { sink = evaluatePostfix(program); });
+    (void)sink;
+
+    report.add(workload + "/scan", text.size() / scan * 1e3, "MB/s", false);
+    report.add(workload + "/parse", parse / tokenCount, "ns/token", true);
+    report.add(workload + "/ast_memory", astBytes(ast) / nodes, "bytes/node", true);
+    report.add(workload + "/evaluate_ast", reduction / nodes, "ns/node", true);
+    report.add(workload + "/compile_and_postfix", compiled / nodes, "ns/node", true);
+    report.add(workload + "/postfix", postfix / nodes, "ns/node", true);
+}
+
+// The interpreter's case: many small expressions, each scanned, parsed and evaluated once
+static void benchmarkLines(BenchmarkReport& report, const vector<string>& lines, int batches) {
+    size_t characters = 0;
+    for (const string& line : lines) {
+        characters += line.size();
+    }
+    vector<AST> trees;
+    for (const string& line : lines) {
+        trees.push_back(parseText(line));
+    }
+    size_t nodes = 0, bytes = 0;
+    for (const AST& ast : trees) {
+        nodes += ast.nodes.size();
+        bytes += astBytes(ast);
+    }
+
+    volatile size_t sink = 0;
+    double scan = measureNanoseconds(batches, 1, [&]() {
+        for (const string& line : lines) {
+            sink = scanLine(line).size();
+        }
+    });
+    double parse = measureNanoseconds(batches, 1, [&]() {
+        for (const string& line : lines) {
+            sink = parseText(line).nodes.size();
+        }
+    });
+    double reduction = measureNanoseconds(batches, 1, [&]() {
+        for (const AST& ast : trees) {
+            sink = evaluateAST(ast, ast.root);
+        }
+    });
+    double compiled = measureNanoseconds(batches, 1, [&]() {
+        for (const AST& ast : trees) {
+            sink = evaluatePostfix(compileExpression(ast));
+        }
+    });
+    (void)sink;
+
+    double count = (double)lines.size();
+    report.add("many_lines/scan", characters / scan * 1e3, "MB/s", false);
+    report.add("many_lines/parse", parse / count, "ns/line", true);
+    report.add("many_lines/ast_memory", (double)bytes / nodes, "bytes/node", true);
+    report.add("many_lines/evaluate_ast", reduction / count, "ns/line", true);
+    report.add("many_lines/compile_and_postfix", compiled / count, "ns/line", true);
+}
+
+// A short expression evaluated over and over, where the per-call overhead shows
+static void benchmarkShort(BenchmarkReport& report, const string& text, int calls) {
+    AST ast = parseText(text);
+    PostfixCode program = compileExpression(ast);
+    volatile int sink = 0;
+    report.add("short/evaluate_ast", measureNanoseconds(5, calls, [&]() { sink = evaluateAST(ast, ast.root); }), "ns/evaluation", true);
+    report.add("short/postfix", measureNanoseconds(5, calls, [&]() { sink = evaluatePostfix(program); }), "ns/evaluation", true);
+    (void)sink;
+}
+
+static void benchmarkColumns(BenchmarkReport& report, const string& text, size_t rows, int batches) {
+    AST ast = parseText(text);
+
+    mt19937 random(141);
+    ColumnTable table;
+    for (const char* name : {"x", "y"}) {
+        vector<int32_t> values(rows);
+        for (int32_t& value : values) {
+            value = (int32_t)(random() % 2001) - 1000;
+        }
+        table.addColumn(name, std::move(values));
+    }
+    ColumnarProgram program(ast, table);
+
+    vector<int32_t> simdResults(rows), scalarResults(rows);
+    vector<uint8_t> simdFlags(rows), scalarFlags(rows);
+    double simd = measureNanoseconds(batches, 1, [&]() { program.run(simdResults.data(), simdFlags.data(), true); });
+    double scalar = measureNanoseconds(batches, 1, [&]() { program.run(scalarResults.data(), scalarFlags.data(), false); });
+    if (simdResults != scalarResults || simdFlags != scalarFlags) {
+        cerr << "columns: the AVX2 and the scalar kernels disagree" << endl;
+        exit(1);
+    }
+
+    report.add("columns/scalar", scalar / rows, "ns/row", true);
+    if (simdSupported()) {
+        report.add("columns/avx2", simd / rows, "ns/row", true);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    BenchmarkOptions options = parseBenchmarkOptions(argc, argv);
+    auto size = [&](int count) { return max(1, (int)(count * options.scale)); };
+
+    BenchmarkReport report("lexp", options.scale);
+    benchmarkExpression(report, "long_line", wideExpression(size(200000)), 10);
+    benchmarkExpression(report, "deep", deepExpression(size(100000)), 10);
+    benchmarkLines(report, shortLines(size(200000)), 5);
+    benchmarkShort(report, "3 * (5 + 2 / 4 - 1)", size(1000000));
+    benchmarkColumns(report, "3 * (5 + 2 / x - 1) + x * y - y", size(1000000), 10);
+
+    report.writeJson(cout);
+    if (!options.compareWith.empty()) {
+        return report.compare(options.compareWith, options.threshold, cerr) > 0 ? 1 : 0;
+    }
+    return 0;
+}
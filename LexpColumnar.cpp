@@ -0,0 +1,444 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Columnar evaluation for Lexp
+Description: This module evaluates one Lexp expression over many rows of variable values.
+             The expression is compiled once into instructions on blocks of rows (see
+             ColumnarProgram), and each instruction runs as a tight loop over the block,
+             with AVX2 kernels (8 rows per instruction) when the processor has them and
+             plain scalar loops otherwise. The columns come from a CSV or a binary file.
+*/
+
+#include "LexpColumnar.h"
+#include "LexpArithmetic.h"
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LEXP_SIMD_SUPPORTED 1
+#else
+#define LEXP_SIMD_SUPPORTED 0
+#endif
+
+using namespace std;
+
+void ColumnTable::addColumn(const string& name, vector<int32_t> values) {
+    if (names.empty()) {
+        rows = values.size();
+    } else if (values.size() != rows) {
+        throw runtime_error("Column " + name + " has " + to_string(values.size()) + " rows instead of " + to_string(rows));
+    }
+    names.push_back(name);
+    owned.push_back(std::move(values));
+    columns.push_back(owned.back().data());
+}
+
+int ColumnTable::find(const string& name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static string trim(string_view text) {
+    size_t start = 0;
+    size_t end = text.size();
+    while (start < end && isspace((unsigned char)text[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)text[end - 1])) {
+        end--;
+    }
+    return string(text.substr(start, end - start));
+}
+
+// Cuts a CSV line at its commas
+static vector<string_view> splitFields(string_view line) {
+    vector<string_view> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t comma = line.find(',', start);
+        if (comma == string_view::npos) {
+            fields.push_back(line.substr(start));
+            return fields;
+        }
+        fields.push_back(line.substr(start, comma - start));
+        start = comma + 1;
+    }
+}
+
+// Parses one CSV field as an int, false if it is not one
+static bool parseValue(string_view field, int32_t& value) {
+    size_t i = 0;
+    while (i < field.size() && isspace((unsigned char)field[i])) {
+        i++;
+    }
+    bool negative = i < field.size() && field[i] == '-';
+    if (negative) {
+        i++;
+    }
+    size_t firstDigit = i;
+    int64_t magnitude = 0;
+    while (i < field.size() && isdigit((unsigned char)field[i])) {
+        magnitude = magnitude * 10 + (field[i] - '0');
+        if (magnitude > (int64_t)INT32_MAX + 1) {
+            return false;
+        }
+        i++;
+    }
+    if (i == firstDigit) {
+        return false;
+    }
+    while (i < field.size() && isspace((unsigned char)field[i])) {
+        i++;
+    }
+    if (i != field.size() || (!negative && magnitude > INT32_MAX)) {
+        return false;
+    }
+    value = (int32_t)(negative ? -magnitude : magnitude);
+    return true;
+}
+
+static ColumnTable loadCsvColumns(const string& path, string_view text) {
+    vector<string> names;
+    vector<vector<int32_t>> values;
+    size_t lineNumber = 0;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == string_view::npos) {
+            end = text.size();
+        }
+        string_view line = text.substr(start, end - start);
+        start = end + 1;
+        lineNumber++;
+        if (isOnlyWhiteSpace(line)) {
+            continue;
+        }
+        string where = path + ":" + to_string(lineNumber) + ": ";
+
+        vector<string_view> fields = splitFields(line);
+        if (names.empty()) {
+            for (string_view field : fields) {
+                string name = trim(field);
+                if (name.empty()) {
+                    throw runtime_error(where + "empty column name");
+                }
+                if (find(names.begin(), names.end(), name) != names.end()) {
+                    throw runtime_error(where + "column " + name + " appears twice");
+                }
+                names.push_back(name);
+            }
+            values.resize(names.size());
+            continue;
+        }
+
+        if (fields.size() != names.size()) {
+            throw runtime_error(where + to_string(fields.size()) + " values for " + to_string(names.size()) + " columns");
+        }
+        for (size_t i = 0; i < fields.size(); i++) {
+            int32_t value;
+            if (!parseValue(fields[i], value)) {
+                throw runtime_error(where + "not an int: \"" + trim(fields[i]) + "\"");
+            }
+            values[i].push_back(value);
+        }
+    }
+    if (names.empty()) {
+        throw runtime_error(path + ": no header line");
+    }
+
+    ColumnTable table;
+    for (size_t i = 0; i < names.size(); i++) {
+        table.addColumn(names[i], std::move(values[i]));
+    }
+    return table;
+}
+
+static const char BINARY_MAGIC[8] = {'L', 'E', 'X', 'P', 'C', 'O', 'L', 'S'};
+
+ColumnTable loadColumns(const string& path) {
+    unique_ptr<MappedFile> file(new MappedFile(path));
+    if (!file->isOpen()) {
+        throw runtime_error("Cannot open " + path);
+    }
+    string_view text = file->text();
+    if (text.size() < sizeof(BINARY_MAGIC) || memcmp(text.data(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        return loadCsvColumns(path, text);
+    }
+
+    // the layout is described in LexpColumnar.h
+    auto corrupt = [&](const string& what) {
+        return runtime_error(path + ": " + what);
+    };
+    auto readUint32 = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, text.data() + offset, 4);
+        return value;
+    };
+    if (text.size() < 24) {
+        throw corrupt("truncated header");
+    }
+    uint32_t count = readUint32(8);
+    uint64_t rows;
+    memcpy(&rows, text.data() + 16, 8);
+
+    ColumnTable table;
+    size_t offset = 24;
+    for (uint32_t i = 0; i < count; i++) {
+        if (text.size() - offset < 4) {
+            throw corrupt("truncated column names");
+        }
+        uint32_t length = readUint32(offset);
+        offset += 4;
+        if (text.size() - offset < length) {
+            throw corrupt("truncated column names");
+        }
+        table.names.push_back(string(text.substr(offset, length)));
+        offset += (length + 3) / 4 * 4;
+        if (offset > text.size()) {
+            throw corrupt("truncated column names");
+        }
+    }
+    if (count > 0 && rows > (text.size() - offset) / 4 / count) {
+        throw corrupt("fewer values than " + to_string(count) + " columns of " + to_string(rows) + " rows");
+    }
+
+    table.rows = count > 0 ? (size_t)rows : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        // offset is a multiple of 4 and the mapping starts on a page, so the ints are aligned
+        table.columns.push_back((const int32_t*)(text.data() + offset) + (size_t)i * table.rows);
+    }
+    table.mapped = std::move(file);
+    return table;
+}
+
+bool simdSupported() {
+#if LEXP_SIMD_SUPPORTED
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+/*
+A kernel applies one operator to count rows. Only division writes to errors: it sets the
+entry of every row whose divisor is 0, and stores 0 as the result of that row.
+*/
+typedef void (*Kernel)(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count);
+
+static void addScalar(int32_t* target, const int32_t* left, const int32_t* right, int32_t*, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        target[i] = lexpAdd(left[i], right[i]);
+    }
+}
+
+static void subtractScalar(int32_t* target, const int32_t* left, const int32_t* right, int32_t*, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        target[i] = lexpSubtract(left[i], right[i]);
+    }
+}
+
+static void multiplyScalar(int32_t* target, const int32_t* left, const int32_t* right, int32_t*, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        target[i] = lexpMultiply(left[i], right[i]);
+    }
+}
+
+static void divideScalar(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (right[i] == 0) {
+            errors[i] = 1;
+            target[i] = 0;
+        } else {
+            target[i] = lexpDivide(left[i], right[i]);
+        }
+    }
+}
+
+#if LEXP_SIMD_SUPPORTED
+
+/*
+The AVX2 kernels do 8 rows per iteration and leave the last count % 8 rows to the scalar ones.
+Adding, subtracting and multiplying are exact on 32-bit lanes (the low half of the product is
+the wrapped product). There is no integer division instruction, so division goes through
+double: every int is exact as a double and the correctly rounded quotient of two of them
+truncates to the integer quotient, including INT_MIN / -1, whose 2^31 converts back to INT_MIN.
+*/
+
+__attribute__((target("avx2")))
+static void addAvx2(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(left + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(right + i));
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_add_epi32(a, b));
+    }
+    addScalar(target + i, left + i, right + i, errors + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void subtractAvx2(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(left + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(right + i));
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_max_epi32(_mm256_sub_epi32(a, b), zero));
+    }
+    subtractScalar(target + i, left + i, right + i, errors + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void multiplyAvx2(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(left + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(right + i));
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_mullo_epi32(a, b));
+    }
+    multiplyScalar(target + i, left + i, right + i, errors + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void divideAvx2(int32_t* target, const int32_t* left, const int32_t* right, int32_t* errors, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(left + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(right + i));
+        __m256i byZero = _mm256_cmpeq_epi32(b, zero);
+        b = _mm256_or_si256(b, _mm256_and_si256(byZero, one)); // divide those rows by 1 instead
+
+        __m256d lowQuotient = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)),
+                                            _mm256_cvtepi32_pd(_mm256_castsi256_si128(b)));
+        __m256d highQuotient = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)),
+                                             _mm256_cvtepi32_pd(_mm256_extracti128_si256(b, 1)));
+        __m256i quotient = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lowQuotient)),
+                                                   _mm256_cvttpd_epi32(highQuotient), 1);
+
+        _mm256_storeu_si256((__m256i*)(target + i), _mm256_andnot_si256(byZero, quotient));
+        __m256i flags = _mm256_loadu_si256((const __m256i*)(errors + i));
+        _mm256_storeu_si256((__m256i*)(errors + i), _mm256_or_si256(flags, byZero));
+    }
+    divideScalar(target + i, left + i, right + i, errors + i, count - i);
+}
+
+#endif
+
+static Kernel kernelFor(NodeKind op, bool useSimd) {
+#if LEXP_SIMD_SUPPORTED
+    if (useSimd) {
+        switch (op) {
+            case NodeKind::PLUS: return addAvx2;
+            case NodeKind::MINUS: return subtractAvx2;
+            case NodeKind::TIMES: return multiplyAvx2;
+            default: return divideAvx2;
+        }
+    }
+#else
+    (void)useSimd;
+#endif
+    switch (op) {
+        case NodeKind::PLUS: return addScalar;
+        case NodeKind::MINUS: return subtractScalar;
+        case NodeKind::TIMES: return multiplyScalar;
+        default: return divideScalar;
+    }
+}
+
+ColumnarProgram::ColumnarProgram(const AST& ast, const ColumnTable& table) : table(table) {
+    if (ast.root == NO_NODE) {
+        throw runtime_error("Empty expression");
+    }
+
+    /*
+    The arena is in post-order (see AST), so one pass with a stack of operands compiles it.
+    An operator's result goes to the lowest register not holding a value still needed, which
+    keeps the registers in use numbered in stack order and their count at the stack depth.
+    */
+    vector<Operand> operands;
+    uint32_t inUse = 0;
+    for (NodeId id = 0; id < ast.nodes.size(); id++) {
+        const ASTnode& n = ast[id];
+        if (n.kind == NodeKind::NUMBER) {
+            if (n.literalTooLarge) {
+                throw runtime_error("Literal too large for an int: " + ast.name(id));
+            }
+            constants.push_back(n.value);
+            operands.push_back(Operand{Operand::CONSTANT, (uint32_t)(constants.size() - 1)});
+        } else if (n.kind == NodeKind::IDENTIFIER) {
+            int column = table.find(ast.name(id));
+            if (column < 0) {
+                throw runtime_error("No column for variable: " + ast.name(id));
+            }
+            operands.push_back(Operand{Operand::COLUMN, (uint32_t)column});
+        } else {
+            Operand right = operands.back();
+            operands.pop_back();
+            Operand left = operands.back();
+            operands.pop_back();
+            inUse -= (left.kind == Operand::REGISTER) + (right.kind == Operand::REGISTER);
+            uint32_t target = inUse++;
+            registers = max(registers, inUse);
+            code.push_back(Instruction{n.kind, target, left, right});
+            operands.push_back(Operand{Operand::REGISTER, target});
+        }
+    }
+    result = operands.back();
+}
+
+size_t ColumnarProgram::run(int32_t* results, uint8_t* divisionByZero, bool useSimd) const {
+    // a block of every register, constant and error flag stays in the L1 cache
+    const size_t BLOCK = 1024;
+    useSimd = useSimd && simdSupported();
+
+    vector<int32_t> registerBlocks((size_t)registers * BLOCK);
+    vector<int32_t> constantBlocks(constants.size() * BLOCK);
+    for (size_t i = 0; i < constants.size(); i++) {
+        fill(constantBlocks.begin() + i * BLOCK, constantBlocks.begin() + (i + 1) * BLOCK, constants[i]);
+    }
+    vector<int32_t> errors(BLOCK);
+    vector<Kernel> kernels;
+    bool divides = false;
+    for (const Instruction& in : code) {
+        kernels.push_back(kernelFor(in.op, useSimd));
+        divides = divides || in.op == NodeKind::DIVIDE;
+    }
+
+    size_t flagged = 0;
+    for (size_t start = 0; start < table.rows; start += BLOCK) {
+        size_t count = min(BLOCK, table.rows - start);
+        auto block = [&](Operand operand) -> const int32_t* {
+            switch (operand.kind) {
+                case Operand::COLUMN: return table.column(operand.index) + start;
+                case Operand::CONSTANT: return constantBlocks.data() + operand.index * BLOCK;
+                default: return registerBlocks.data() + operand.index * BLOCK;
+            }
+        };
+
+        if (divides) {
+            fill(errors.begin(), errors.begin() + count, 0);
+        }
+        for (size_t i = 0; i < code.size(); i++) {
+            const Instruction& in = code[i];
+            kernels[i](registerBlocks.data() + in.target * BLOCK, block(in.left), block(in.right), errors.data(), count);
+        }
+
+        const int32_t* values = block(result);
+        for (size_t i = 0; i < count; i++) {
+            bool failed = divides && errors[i] != 0;
+            results[start + i] = failed ? 0 : values[i];
+            divisionByZero[start + i] = failed;
+            flagged += failed;
+        }
+    }
+    return flagged;
+}
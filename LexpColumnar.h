@@ -0,0 +1,100 @@
+#ifndef LEXP_COLUMNAR_H
+#define LEXP_COLUMNAR_H
+
+#include "LexpParser.h"
+#include "LexpBatch.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/*
+The values of the variables of an expression, one int column per variable, all with the
+same number of rows. loadColumns reads either format below, told apart by the magic:
+
+CSV: a header line with the variable names, then one line of integers per row, separated
+by commas, for example
+    x,y
+    1,2
+    10,0
+
+Binary (little-endian, made to be written straight from an array library):
+    "LEXPCOLS"                           8 bytes
+    uint32 column count, uint32 0        8 bytes
+    uint64 row count                     8 bytes
+    per column: uint32 name length, the name, zero padding up to a multiple of 4 bytes
+    per column, in the same order: row count int32 values
+The binary file is memory-mapped and its columns are used in place.
+*/
+class ColumnTable {
+    public:
+        vector<string> names;
+        size_t rows = 0;
+
+        // Adds a column owned by the table; every column must have the same number of rows
+        void addColumn(const string& name, vector<int32_t> values);
+
+        // Index of the column called name, -1 if there is none
+        int find(const string& name) const;
+
+        const int32_t* column(size_t index) const { return columns[index]; }
+
+    private:
+        vector<const int32_t*> columns;
+        vector<vector<int32_t>> owned;
+        unique_ptr<MappedFile> mapped;
+
+        friend ColumnTable loadColumns(const string& path);
+};
+
+// Throws runtime_error naming the problem when the file cannot be read
+ColumnTable loadColumns(const string& path);
+
+// Whether this machine runs the AVX2 kernels; otherwise the scalar ones are used
+bool simdSupported();
+
+/*
+One expression compiled for a ColumnTable: identifiers read their column, and every operator
+becomes one instruction applied to a whole block of rows at a time, 8 rows per AVX2 instruction.
+The arithmetic is Lexp's own (LexpArithmetic.h): wrapping +, - and *, subtraction clamped at 0,
+truncating division. A division by zero does not stop the run; it only flags its row, and the
+result of a flagged row is 0.
+The constructor throws runtime_error for an identifier without a column and for a literal too
+large for an int, since either would fail on every row.
+*/
+class ColumnarProgram {
+    public:
+        ColumnarProgram(const AST& ast, const ColumnTable& table);
+
+        /*
+        Evaluates every row of the table into results, and sets divisionByZero[row] to 1 for the
+        rows that divided by zero (0 for the others). Both arrays need table.rows entries.
+        Returns the number of flagged rows. useSimd = false forces the scalar kernels.
+        */
+        size_t run(int32_t* results, uint8_t* divisionByZero, bool useSimd = true) const;
+
+    private:
+        // Where an instruction reads a block of values from
+        struct Operand {
+            enum Kind : uint8_t { COLUMN, CONSTANT, REGISTER } kind;
+            uint32_t index;
+        };
+
+        struct Instruction {
+            NodeKind op;
+            uint32_t target; // register
+            Operand left;
+            Operand right;
+        };
+
+        const ColumnTable& table;
+        vector<Instruction> code;
+        vector<int32_t> constants;
+        Operand result;
+        uint32_t registers = 0;
+};
+
+#endif
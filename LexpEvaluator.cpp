@@ -0,0 +1,267 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang  
+Phase 3.1: Evaluator for Lexp  
+Description: This module evaluates the Abstract Syntax Tree (AST) produced by the parser.  
+             evaluateAST performs a pre-order traversal to evaluate expressions.  
+             Using a stack-based approach, it pushes nodes onto a stack and evaluates  
+             when possible (when the top three elements are two numbers followed by an operator).  
+             compileExpression turns the AST into postfix code once, which evaluatePostfix  
+             then runs on a plain int stack with the same results and the same errors.  
+*/
+
+#include "LexpEvaluator.h"
+#include "LexpArithmetic.h"
+#include <vector>
+#include <string>
+#include <stack>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+/*
+// THIS IS NOT STACK YET
+int evaluateAST(shared_ptr<ASTnode> node) {
+    if (!node -> right && !node -> left) {
+        return stoi(node -> value);
+    }
+    int leftVal = evaluateAST(node -> left);
+    int rightVal = evaluateAST(node -> right);
+
+    if (node -> value == "+") {
+        return leftVal + rightVal;
+    } else if (node -> value == "-") {
+        return leftVal - rightVal;
+    } else if (node -> value == "*") {
+        return leftVal * rightVal;
+    } else if (node -> value == "/") {
+        if (rightVal == 0) {
+            throw runtime_error("Division by zero");
+        }
+        return leftVal / rightVal;
+    }
+    throw runtime_error("Unknown operator");
+}
+*/
+
+/*
+An entry of the evaluation stack. Operators keep their node kind, numbers and
+intermediate results are NUMBER entries carrying their value, and identifiers
+stay IDENTIFIER entries since they can never be reduced.
+*/
+struct EvalItem {
+    NodeKind kind;
+    bool literalTooLarge;
+    int value;
+};
+
+static bool isValue(const EvalItem& item) {
+    return item.kind == NodeKind::NUMBER;
+}
+
+static bool isOperator(const EvalItem& item) {
+    return item.kind != NodeKind::NUMBER && item.kind != NodeKind::IDENTIFIER;
+}
+
+// Reads the value of an operand, failing the way stoi did on the literal's text
+static int operandValue(const EvalItem& item) {
+    if (item.kind == NodeKind::IDENTIFIER) {
+        throw invalid_argument("stoi");
+    }
+    if (item.literalTooLarge) {
+        throw out_of_range("stoi");
+    }
+    return item.value;
+}
+
+int evaluateAST(const AST& ast, NodeId root) {
+    stack<EvalItem> evalStack; // Stack for evaluation
+    stack<NodeId> traversalStack;// Stack for traversal (to implement pre-order traversal iteratively)
+    
+    // Push the root to start traversal
+    if (root != NO_NODE) {
+        traversalStack.push(root);
+    }
+    
+    // Pre-order traversal
+    while (!traversalStack.empty()) {
+        // Get the next node in pre-order
+        const ASTnode& current = ast[traversalStack.top()];
+        traversalStack.pop();
+        
+        // Push right child first
+        // so it's processed after the left child
+        if (current.right != NO_NODE) {
+            traversalStack.push(current.right);
+        }
+        if (current.left != NO_NODE) {
+            traversalStack.push(current.left);
+        }
+        
+        // Push current node to evaluation stack
+        evalStack.push(EvalItem{current.kind, current.literalTooLarge, current.value});
+        
+        // Check if we can evaluate the top three elements
+        while (evalStack.size() >= 3) {
+            // Get the top three elements without popping
+            EvalItem top1 = evalStack.top();
+            evalStack.pop();
+            EvalItem top2 = evalStack.top();
+            evalStack.pop();
+            EvalItem top3 = evalStack.top();
+            evalStack.pop();
+            
+            // Check if we can evaluate (top two are numbers, third is an operator)
+            bool canEvaluate = false;
+            if (isValue(top1) && isValue(top2) && isOperator(top3)) {
+                
+                int num1 = operandValue(top1);
+                int num2 = operandValue(top2);
+                int result = 0;
+                
+                // Apply the operator
+                if (top3.kind == NodeKind::PLUS) {
+                    result = lexpAdd(num2, num1);  // Note: stack order reverses operands
+                } else if (top3.kind == NodeKind::MINUS) {
+                    result = lexpSubtract(num2, num1);
+                } else if (top3.kind == NodeKind::TIMES) {
+                    result = lexpMultiply(num2, num1);
+                } else if (top3.kind == NodeKind::DIVIDE) {
+                    result = lexpDivide(num2, num1);
+                } else {
+                    throw runtime_error("Unknown operator");
+                }
+                
+                // Push the result back as an already evaluated operand
+                evalStack.push(EvalItem{NodeKind::NUMBER, false, result});
+                canEvaluate = true;
+            }
+            
+            // If we couldn't evaluate, push the elements back in reverse order
+            if (!canEvaluate) {
+                evalStack.push(top3);
+                evalStack.push(top2);
+                evalStack.push(top1);
+                break;
+            }
+        }
+    }
+    
+    // the stack should have exactly one element with the final result
+    if (evalStack.size() != 1) {
+        throw runtime_error("Invalid expression: evaluation did not result in a single value");
+    }
+    
+    // return the final result
+    return operandValue(evalStack.top());
+}
+
+
+PostfixCode compileExpression(const AST& ast) {
+    PostfixCode program;
+    compileExpression(ast, program);
+    return program;
+}
+
+void compileExpression(const AST& ast, PostfixCode& program) {
+    program.code.clear();
+    program.maxStackDepth = 0;
+    program.outcome = PostfixCode::VALUE;
+    if (ast.root == NO_NODE) {
+        program.outcome = PostfixCode::NOT_REDUCED;
+        return;
+    }
+
+    /*
+    The parser creates a left operand, then the right operand, then the operator, and every
+    node is part of the tree (see AST), so index order is post-order: the order in which the
+    reduction happens. A subexpression without identifiers is reduced completely; an operator
+    with an identifier below it is never reduced, so it gets no code, and the values of its
+    identifier-free operands are simply left on the stack (evaluating them still raises the
+    same errors, from left to right).
+    */
+    // most expressions fit in the fixed flags, as in evaluatePostfix
+    uint8_t fixedPure[64] = {};
+    vector<uint8_t> largePure;
+    uint8_t* pure = fixedPure;
+    if (ast.nodes.size() > 64) {
+        largePure.resize(ast.nodes.size());
+        pure = largePure.data();
+    }
+    program.code.reserve(ast.nodes.size() + 1);
+    int depth = 0;
+    auto isTooLarge = [&](NodeId node) {
+        return ast[node].kind == NodeKind::NUMBER && ast[node].literalTooLarge;
+    };
+    for (NodeId id = 0; id < ast.nodes.size(); id++) {
+        const ASTnode& n = ast[id];
+        if (n.kind == NodeKind::NUMBER) {
+            // a literal too large for an int only fails once an operator uses it
+            program.code.push_back(PostfixInstruction{PostfixOp::PUSH, n.literalTooLarge ? 0 : n.value});
+            program.maxStackDepth = max(program.maxStackDepth, ++depth);
+            pure[id] = 1;
+        } else if (n.kind != NodeKind::IDENTIFIER && pure[n.left] && pure[n.right]) {
+            PostfixOp op = isTooLarge(n.left) || isTooLarge(n.right) ? PostfixOp::FAIL_STOI
+                           : n.kind == NodeKind::PLUS                ? PostfixOp::ADD
+                           : n.kind == NodeKind::MINUS               ? PostfixOp::SUBTRACT
+                           : n.kind == NodeKind::TIMES               ? PostfixOp::MULTIPLY
+                                                                     : PostfixOp::DIVIDE;
+            program.code.push_back(PostfixInstruction{op, 0});
+            depth--;
+            pure[id] = 1;
+        }
+    }
+
+    if (!pure[ast.root]) {
+        program.outcome = ast[ast.root].kind == NodeKind::IDENTIFIER ? PostfixCode::BARE_IDENTIFIER
+                                                                      : PostfixCode::NOT_REDUCED;
+    } else if (isTooLarge(ast.root)) {
+        program.code.push_back(PostfixInstruction{PostfixOp::FAIL_STOI, 0});
+    }
+}
+
+int evaluatePostfix(const PostfixCode& program) {
+    // most expressions fit in the fixed stack, only very right-deep ones need more
+    int fixedStack[64];
+    vector<int> largeStack;
+    int* sp = fixedStack;
+    if (program.maxStackDepth > 64) {
+        largeStack.resize(program.maxStackDepth);
+        sp = largeStack.data();
+    }
+
+    for (const PostfixInstruction& in : program.code) {
+        switch (in.op) {
+            case PostfixOp::PUSH:
+                *sp++ = in.operand;
+                break;
+            case PostfixOp::ADD:
+                sp--;
+                sp[-1] = lexpAdd(sp[-1], sp[0]);
+                break;
+            case PostfixOp::SUBTRACT:
+                sp--;
+                sp[-1] = lexpSubtract(sp[-1], sp[0]);
+                break;
+            case PostfixOp::MULTIPLY:
+                sp--;
+                sp[-1] = lexpMultiply(sp[-1], sp[0]);
+                break;
+            case PostfixOp::DIVIDE:
+                sp--;
+                sp[-1] = lexpDivide(sp[-1], sp[0]);
+                break;
+            case PostfixOp::FAIL_STOI:
+                // the same exception stoi used to throw for the literal
+                throw out_of_range("stoi");
+        }
+    }
+
+    if (program.outcome == PostfixCode::BARE_IDENTIFIER) {
+        throw invalid_argument("stoi");
+    }
+    if (program.outcome == PostfixCode::NOT_REDUCED) {
+        throw runtime_error("Invalid expression: evaluation did not result in a single value");
+    }
+    return sp[-1];
+}
@@ -0,0 +1,58 @@
+#ifndef LEXP_EVALUATOR_H
+#define LEXP_EVALUATOR_H
+
+#include "LexpParser.h"
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+/*
+Evaluates the expression rooted at root by the pre-order stack reduction: nodes are pushed
+in pre-order and the top three stack entries are reduced whenever they are an operator
+followed by two numbers. Kept as the reference the postfix code is checked against.
+*/
+int evaluateAST(const AST& ast, NodeId root);
+
+enum class PostfixOp : uint8_t {
+    PUSH,        // push operand
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    FAIL_STOI    // an operator applied to a literal too large for an int, fails when reached
+};
+
+struct PostfixInstruction {
+    PostfixOp op;
+    int32_t operand;
+};
+
+/*
+An expression compiled to postfix (reverse Polish) order, evaluated with a plain int stack.
+The stack reduction never reduces an operator that has an identifier below it, but still
+reduces everything else (so a division by zero elsewhere still fails); for such expressions
+the code only evaluates the identifier-free subexpressions, and outcome says which error
+is left to report at the end.
+*/
+struct PostfixCode {
+    enum Outcome : uint8_t {
+        VALUE,           // the last value on the stack is the result
+        BARE_IDENTIFIER, // the expression is a single identifier ("stoi")
+        NOT_REDUCED      // "Invalid expression: evaluation did not result in a single value"
+    };
+
+    vector<PostfixInstruction> code;
+    int maxStackDepth = 0;
+    Outcome outcome = VALUE;
+};
+
+PostfixCode compileExpression(const AST& ast);
+
+// The same into program, whose code keeps its memory from the expression compiled into it before
+void compileExpression(const AST& ast, PostfixCode& program);
+
+// Same result and same errors as evaluateAST on the AST the code was compiled from
+int evaluatePostfix(const PostfixCode& program);
+
+#endif
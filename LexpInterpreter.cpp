@@ -1,206 +1,601 @@
 /*
 Name: Hoang Mai Han Dang, Yazi Zhang  
 Phase 3.1: Interpreter for Lexp  
-Description: This program implements an evaluator module for Lexp.  
-             The evaluator receives the Abstract Syntax Tree (AST) from the parser  
-             and performs a pre-order traversal to evaluate expressions.  
-             Using a stack-based approach, it pushes nodes onto a stack and evaluates  
-             when possible (when the top three elements are two numbers followed by an operator).  
-             The final result of evaluation is returned as a single numeric value.  
+Description: This program implements the interpreter for Lexp.  
+             Every line is scanned, parsed into an Abstract Syntax Tree (AST) and  
+             evaluated (see LexpEvaluator.cpp), and the tokens, the AST and the  
+             result are written to the output file.  
 */
 
 #include "LexpParser.h"
+#include "LexpEvaluator.h"
+#include "LexpOptimizer.h"
+#include "LexpBatch.h"
+#include "LexpColumnar.h"
+#include "Trace.h"
+#include "Server.h"
+#include "RecordWriter.h"
 #include <iostream>
 #include <regex>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <cctype>
 #include <algorithm>
 #include <memory>
 #include <utility>
 #include <stack>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <charconv>
+#include <unistd.h>
 
 using namespace std;
 
 /*
-// THIS IS NOT STACK YET
-int evaluateAST(shared_ptr<ASTnode> node) {
-    if (!node -> right && !node -> left) {
-        return stoi(node -> value);
-    }
-    int leftVal = evaluateAST(node -> left);
-    int rightVal = evaluateAST(node -> right);
-
-    if (node -> value == "+") {
-        return leftVal + rightVal;
-    } else if (node -> value == "-") {
-        return leftVal - rightVal;
-    } else if (node -> value == "*") {
-        return leftVal * rightVal;
-    } else if (node -> value == "/") {
-        if (rightVal == 0) {
-            throw runtime_error("Division by zero");
-        }
-        return leftVal / rightVal;
-    }
-    throw runtime_error("Unknown operator");
+What translateLine works in, kept from one line to the next so that a line no larger than one
+translated before allocates no memory. Each thread has its own, the batch mode and the server
+translate lines on several.
+*/
+struct LineWorkspace {
+    vector<Token> tokens;
+    AST ast;
+    PostfixCode program; // interpretLine's
+};
+
+static thread_local LineWorkspace workspace;
+
+// How the line by line modes report a line
+struct LineOptions {
+    OutputFormat format = OutputFormat::TEXT;
+    bool resultsOnly = false;
+    bool foldAST = false;
+};
+
+/*
+The first half of interpretLine: writes the tokens and the AST of a line that is not only white
+space to listing (unless it is null, when only the results are wanted), as text or as records
+(see RecordWriter.h), and compiles it into program. Returns false when the line ends in an error
+before it can be evaluated, with the error to report (which is not written) in error.
+*/
+static bool translateLine(string_view line, ostream* listing, OutputFormat format, bool foldAST, int& foldedNodes,
+                          Trace* trace, PostfixCode& program, string& error) {
+    TraceSpan scanSpan(trace, "scan");
+    vector<Token>& tokens = workspace.tokens;
+    scanLine(line, tokens);
+    scanSpan.end();
+    traceCount(trace, "tokens scanned", (long long)tokens.size());
+
+    TraceSpan writeSpan(trace, "write tokens");
+    bool text = format == OutputFormat::TEXT;
+    if (listing && text) {
+        *listing << "Tokens:\n";
+    }
+    for (const Token &token : tokens) {
+        if (token.kind == TokenKind::ERROR) {
+            error = "ERROR READING: \"" + string(token.value) + "\"\n";
+            return false;
+        }
+        if (listing && !text) {
+            RecordWriter(*listing, format).token((uint8_t)token.kind, tokenKindName(token.kind), token.value);
+        }
+        else if (listing) {
+            // straight into the stream's buffer, as printAST does: these lines are most of the output
+            streambuf& buffer = *listing->rdbuf();
+            const char* kindName = tokenKindName(token.kind);
+            buffer.sputn(token.value.data(), (streamsize)token.value.size());
+            buffer.sputn(": ", 2);
+            buffer.sputn(kindName, (streamsize)strlen(kindName));
+            buffer.sputc('\n');
+        }
+    }
+    if (listing && text) {
+        *listing << "\n";
+    }
+    writeSpan.end();
+
+    TraceSpan parseSpan(trace, "parse");
+    // the stream borrows the token vector and gives it back, with its memory, once the line is parsed
+    TokenStream ts(std::move(tokens));
+    AST& ast = workspace.ast;
+    ast.clear();
+    bool parsed = true;
+    try {
+        ast.root = parseExpression(ts, ast);
+    } catch (const ParseError& e) {
+        error = string(e.what()) + "\n";
+        parsed = false;
+    }
+    Token nextToken = ts.peek();
+    tokens = std::move(ts.tokens);
+    if (!parsed) {
+        return false;
+    }
+    parseSpan.end();
+    traceCount(trace, "nodes allocated", (long long)ast.nodes.size());
+    if (nextToken.kind != TokenKind::END_OF_FILE) {
+        error = "ERROR IN PARSER: Unexpected token after expression: " + string(nextToken.value) + "\n\n";
+        return false;
+    }
+
+    if (listing) {
+        TraceSpan printSpan(trace, "print AST");
+        if (text) {
+            *listing << "AST:\n";
+            printAST(ast, ast.root, *listing);
+        } else {
+            RecordWriter records(*listing, format);
+            forEachASTLine(ast, ast.root, [&](const ASTLine& line) {
+                records.astNode((uint32_t)line.depth, (uint8_t)ast[line.node].kind, line.type, line.text);
+            });
+        }
+    }
+    if (foldAST) {
+        TraceSpan foldSpan(trace, "fold constants");
+        foldedNodes += foldConstants(ast);
+    }
+
+    try {
+        TraceSpan compileSpan(trace, "compile");
+        compileExpression(ast, program);
+    } catch (const exception &e) {
+        error = "Evaluation Error: " + string(e.what()) + "\n";
+        return false;
+    }
+    return true;
+}
+
+// The second half: writes the result of the compiled line, or its error, to out in format
+static bool evaluateLine(const PostfixCode& program, ostream& out, OutputFormat format, Trace* trace) {
+    try {
+        TraceSpan evaluateSpan(trace, "evaluate");
+        int result = evaluatePostfix(program);
+        evaluateSpan.arg("steps", (long long)program.code.size());
+        evaluateSpan.end();
+        traceCount(trace, "evaluation steps", (long long)program.code.size());
+        if (format == OutputFormat::TEXT) {
+            out << "Result: " << result << "\n\n";
+        } else {
+            RecordWriter(out, format).result(result);
+        }
+    } catch (const exception &e) {
+        if (format == OutputFormat::TEXT) {
+            out << "Evaluation Error: " << e.what() << "\n";
+        } else {
+            RecordWriter(out, format).error("Evaluation Error: " + string(e.what()));
+        }
+        return false;
+    }
+    return true;
 }
+
+/*
+Everything the interpreter reports for one input line: its tokens, its AST and its result, or with
+resultsOnly only the result (or the error the line ended in).
+Returns false when the line ends in an error (after reporting it). The normal mode stops
+the whole run there, the batch and stream modes carry on with the next line.
+With a trace, every phase of the line is a span (see Trace.h).
 */
+static bool interpretLine(string_view line, ostream& out, const LineOptions& options, int& foldedNodes, Trace* trace) {
+    if (isOnlyWhiteSpace(line)) {
+        return true;
+    }
+    string error;
+    if (!translateLine(line, options.resultsOnly ? nullptr : &out, options.format, options.foldAST, foldedNodes, trace,
+                       workspace.program, error)) {
+        if (options.format == OutputFormat::TEXT) {
+            out << error;
+        } else {
+            RecordWriter(out, options.format).error(error);
+        }
+        return false;
+    }
+    return evaluateLine(workspace.program, out, options.format, trace);
+}
 
-int evaluateAST(shared_ptr<ASTnode> root) {
-    stack<shared_ptr<ASTnode>> evalStack; // Stack for evaluation
-    stack<shared_ptr<ASTnode>> traversalStack;// Stack for traversal (to implement pre-order traversal iteratively)
-    
-    // Push the root to start traversal
-    if (root) {
-        traversalStack.push(root);
+/*
+interpretLine inside a "line" span that reports the bytes it wrote. Asking out for its position
+costs a system call on a file, so it is only done when tracing.
+*/
+static bool interpretTracedLine(string_view line, ostream& out, const LineOptions& options, int& foldedNodes, Trace* trace) {
+    if (!trace) {
+        return interpretLine(line, out, options, foldedNodes, nullptr);
     }
-    
-    // Pre-order traversal
-    while (!traversalStack.empty()) {
-        // Get the next node in pre-order
-        shared_ptr<ASTnode> current = traversalStack.top();
-        traversalStack.pop();
-        
-        // Push right child first
-        // so it's processed after the left child
-        if (current->right) {
-            traversalStack.push(current->right);
-        }
-        if (current->left) {
-            traversalStack.push(current->left);
-        }
-        
-        // Push current node to evaluation stack
-        evalStack.push(current);
-        
-        // Check if we can evaluate the top three elements
-        while (evalStack.size() >= 3) {
-            // Get the top three elements without popping
-            shared_ptr<ASTnode> top1 = evalStack.top();
-            evalStack.pop();
-            shared_ptr<ASTnode> top2 = evalStack.top();
-            evalStack.pop();
-            shared_ptr<ASTnode> top3 = evalStack.top();
-            evalStack.pop();
-            
-            // Check if we can evaluate (top two are numbers, third is an operator)
-            bool canEvaluate = false;
-            if ((top1->type == "NUMBER" || top1->type == "EVALUATED") && 
-                (top2->type == "NUMBER" || top2->type == "EVALUATED") &&
-                top3->type == "SYMBOL") {
-                
-                // Convert string values to integers
-                int num1 = stoi(top1->value);
-                int num2 = stoi(top2->value);
-                int result = 0;
-                
-                // Apply the operator
-                if (top3->value == "+") {
-                    result = num2 + num1;  // Note: stack order reverses operands
-                } else if (top3->value == "-") {
-                    result = num2 - num1;
-                    if (result < 0) {
-                        result = 0;
-                    }
-                } else if (top3->value == "*") {
-                    result = num2 * num1;
-                } else if (top3->value == "/") {
-                    if (num1 == 0) {
-                        throw runtime_error("Division by zero");
-                    }
-                    result = num2 / num1;
-                } else {
-                    throw runtime_error("Unknown operator");
+    TraceSpan span(trace, "line");
+    streamoff before = out.tellp();
+    bool ok = interpretLine(line, out, options, foldedNodes, trace);
+    streamoff after = out.tellp();
+    if (before >= 0 && after >= before) {
+        span.arg("bytes", (long long)(after - before));
+        trace->count("bytes written", (long long)(after - before));
+    }
+    return ok;
+}
+
+/*
+Evaluates every expression of the input file over the rows of a column file (see LexpColumnar.h)
+and writes a CSV file with one column per expression, headed by the expression itself, and one
+line per row. A row that divided by zero reads "Division by zero" instead of a value.
+An expression that cannot be evaluated on any row is reported on the console and stops the run.
+*/
+static int interpretColumns(const string& inputFilePath, const string& columnsPath, const string& outputFilePath, bool useSimd, Trace* trace) {
+    ifstream inputFile(inputFilePath);
+    if (!inputFile.is_open()) {
+        cerr << "ERROR OPENING FILE" << endl;
+        return 1;
+    }
+    ColumnTable table;
+    try {
+        TraceSpan loadSpan(trace, "load columns");
+        table = loadColumns(columnsPath);
+        loadSpan.arg("rows", (long long)table.rows);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    vector<string> headers;
+    vector<vector<int32_t>> results;
+    vector<vector<uint8_t>> divisionByZero;
+    string line;
+    int lineNumber = 0;
+    while (getline(inputFile, line)) {
+        lineNumber++;
+        if (isOnlyWhiteSpace(line)) {
+            continue;
+        }
+        try {
+            TraceSpan scanSpan(trace, "scan");
+            vector<Token> tokens = scanLine(line);
+            scanSpan.end();
+            traceCount(trace, "tokens scanned", (long long)tokens.size());
+            for (const Token &token : tokens) {
+                if (token.kind == TokenKind::ERROR) {
+                    throw runtime_error("ERROR READING: \"" + string(token.value) + "\"");
                 }
-                
-                // Create a new node with the result and push it back
-                evalStack.push(make_shared<ASTnode>(to_string(result), "EVALUATED"));
-                canEvaluate = true;
             }
-            
-            // If we couldn't evaluate, push the elements back in reverse order
-            if (!canEvaluate) {
-                evalStack.push(top3);
-                evalStack.push(top2);
-                evalStack.push(top1);
-                break;
+            TraceSpan parseSpan(trace, "parse");
+            TokenStream ts(std::move(tokens));
+            AST ast;
+            ast.root = parseExpression(ts, ast);
+            parseSpan.end();
+            traceCount(trace, "nodes allocated", (long long)ast.nodes.size());
+            if (ts.peek().kind != TokenKind::END_OF_FILE) {
+                throw runtime_error("ERROR IN PARSER: Unexpected token after expression: " + string(ts.peek().value));
+            }
+            TraceSpan compileSpan(trace, "compile");
+            foldConstants(ast);
+            ColumnarProgram program(ast, table);
+            compileSpan.end();
+
+            TraceSpan evaluateSpan(trace, "evaluate columns");
+            results.emplace_back(table.rows);
+            divisionByZero.emplace_back(table.rows);
+            size_t flagged = program.run(results.back().data(), divisionByZero.back().data(), useSimd);
+            evaluateSpan.arg("rows", (long long)table.rows);
+            evaluateSpan.end();
+            traceCount(trace, "evaluation steps", (long long)table.rows);
+            if (flagged > 0) {
+                cerr << "Line " << lineNumber << ": " << flagged << " rows divided by zero" << endl;
             }
+        } catch (const exception &e) {
+            cerr << "Line " << lineNumber << ": " << e.what() << endl;
+            return 1;
         }
+        size_t start = line.find_first_not_of(" \t\r");
+        size_t end = line.find_last_not_of(" \t\r");
+        headers.push_back(line.substr(start, end - start + 1));
     }
-    
-    // the stack should have exactly one element with the final result
-    if (evalStack.size() != 1) {
-        throw runtime_error("Invalid expression: evaluation did not result in a single value");
+
+    ofstream outputFile(outputFilePath, ios::binary);
+    if (!outputFile.is_open()) {
+        cerr << "ERROR OPENING FILE" << endl;
+        return 1;
     }
-    
-    // return the final result
-    return stoi(evalStack.top()->value);
+    for (size_t i = 0; i < headers.size(); i++) {
+        outputFile << (i > 0 ? "," : "") << headers[i];
+    }
+    outputFile << "\n";
+
+    // the rows are formatted into a buffer by hand, ostream's number formatting would dominate
+    TraceSpan writeSpan(trace, "write CSV");
+    long long bytes = 0;
+    string buffer;
+    const char divisionError[] = "Division by zero";
+    for (size_t row = 0; row < table.rows; row++) {
+        for (size_t i = 0; i < results.size(); i++) {
+            if (i > 0) {
+                buffer += ',';
+            }
+            if (divisionByZero[i][row]) {
+                buffer += divisionError;
+            } else {
+                char digits[16];
+                buffer.append(digits, to_chars(digits, digits + sizeof(digits), results[i][row]).ptr);
+            }
+        }
+        buffer += '\n';
+        if (buffer.size() >= 1 << 20) {
+            outputFile.write(buffer.data(), (streamsize)buffer.size());
+            bytes += (long long)buffer.size();
+            buffer.clear();
+        }
+    }
+    outputFile.write(buffer.data(), (streamsize)buffer.size());
+    bytes += (long long)buffer.size();
+    writeSpan.arg("bytes", bytes);
+    writeSpan.end();
+    traceCount(trace, "bytes written", bytes);
+
+    cerr << "Evaluated " << headers.size() << " expressions over " << table.rows << " rows ("
+         << (useSimd && simdSupported() ? "AVX2" : "scalar") << ")" << endl;
+    return 0;
+}
+
+// What translateLine made of one line of a source, the first time a request sent it
+struct PreparedLine {
+    string listing; // the tokens and the AST
+    string error;   // the error the line ended in, empty when it compiled
+    PostfixCode program;
+};
+
+/*
+Runs LexpInterpreter --serve (see Server.h) until it is interrupted. The lines of a source are
+translated the first time it is sent and kept in a ProgramCache, so the same source sent again is
+only evaluated. As in the normal mode, the answer stops at the first line with an error.
+Lexp expressions always end, so the limits a request may give do not apply.
+*/
+static int serveLexp(const ServerOptions& options, bool foldAST) {
+    ProgramCache<vector<PreparedLine>> cache(options.cacheEntries);
+    int status = serveUnixSocket(options, [&](const string& payload) {
+        ServerRequest request;
+        string error;
+        if (!parseServerRequest(payload, request, error)) {
+            return serverResponse("rejected", error + "\n");
+        }
+        if (request.language != "lexp") {
+            return serverResponse("rejected", "This server runs Lexp programs\n");
+        }
+
+        shared_ptr<const vector<PreparedLine>> lines = cache.find(request.source);
+        if (!lines) {
+            auto prepared = make_shared<vector<PreparedLine>>();
+            int foldedNodes = 0;
+            string_view source = request.source;
+            for (size_t lineStart = 0; lineStart < source.size();) {
+                size_t lineEnd = min(source.find('\n', lineStart), source.size());
+                string_view line = source.substr(lineStart, lineEnd - lineStart);
+                lineStart = lineEnd + 1;
+                if (isOnlyWhiteSpace(line)) {
+                    continue;
+                }
+                PreparedLine translated;
+                ostringstream listing;
+                bool ok = translateLine(line, &listing, OutputFormat::TEXT, foldAST, foldedNodes, nullptr,
+                                        translated.program, translated.error);
+                translated.listing = listing.str();
+                prepared->push_back(std::move(translated));
+                if (!ok) {
+                    break;
+                }
+            }
+            lines = prepared;
+            cache.insert(request.source, lines);
+        }
+
+        // "full" is the whole output file; otherwise the results, or the error that ended them
+        ostringstream out;
+        for (const PreparedLine& line : *lines) {
+            if (request.full) {
+                out << line.listing;
+            }
+            if (!line.error.empty()) {
+                out << line.error;
+                return serverResponse("error", out.str());
+            }
+            if (!evaluateLine(line.program, out, OutputFormat::TEXT, nullptr)) {
+                return serverResponse("error", out.str());
+            }
+        }
+        return serverResponse("ok", out.str());
+    });
+    if (status == 0) {
+        cerr << "Program cache: " << cache.hitCount() << " hits, " << cache.missCount() << " misses" << endl;
+    }
+    return status;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        cout << "Usage: ./LexpInterpreter <input_file> <output_file>" << endl;
+    /*
+    --fold replaces constant subexpressions by their value after the AST is printed.
+    --batch runs the lines on a pool of threads (see LexpBatch.h) and reports an error
+    on a line without stopping at it; --threads=N sets the size of the pool.
+    --columns=FILE evaluates the expressions over the rows of FILE instead (see
+    interpretColumns); --no-simd keeps that on the scalar kernels.
+    --trace=FILE writes how long each phase of each line took, with the tokens, nodes, bytes and
+    steps it handled, to FILE in the Chrome trace event format (see Trace.h).
+    --serve=SOCKET answers requests on a Unix-domain socket instead of running one file (see
+    serveLexp), on --threads=N workers, keeping up to --cached-programs=N sources translated.
+    --stream reads the lines from standard input as they arrive and writes to standard output
+    (see processLineStream), carrying on after a line with an error like --batch; the output is
+    written at the latest --flush-ms=N milliseconds (10 by default) after the last write.
+    --results-only writes only the result or the error of each line, without its tokens and AST.
+    --format=jsonl|binary writes records instead of text (see RecordWriter.h); --columns and
+    --serve always answer in text.
+    */
+    LineOptions lineOptions;
+    bool batch = false;
+    bool stream = false;
+    int flushMilliseconds = 10;
+    bool useSimd = true;
+    string columnsPath;
+    string tracePath;
+    ServerOptions server;
+    unsigned threads = thread::hardware_concurrency();
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--fold") {
+            lineOptions.foldAST = true;
+        }
+        else if (arg == "--batch") {
+            batch = true;
+        }
+        else if (arg == "--stream") {
+            stream = true;
+        }
+        else if (arg == "--results-only") {
+            lineOptions.resultsOnly = true;
+        }
+        else if (arg.rfind("--format=", 0) == 0) {
+            if (!parseOutputFormat(arg.substr(strlen("--format=")), lineOptions.format)) {
+                cerr << "Unknown format: " << arg.substr(strlen("--format=")) << " (text, jsonl or binary)" << endl;
+                return 1;
+            }
+        }
+        else if (arg.rfind("--flush-ms=", 0) == 0) {
+            flushMilliseconds = atoi(arg.c_str() + strlen("--flush-ms="));
+        }
+        else if (arg.rfind("--columns=", 0) == 0) {
+            columnsPath = arg.substr(strlen("--columns="));
+        }
+        else if (arg == "--no-simd") {
+            useSimd = false;
+        }
+        else if (arg.rfind("--threads=", 0) == 0) {
+            threads = (unsigned)atoi(arg.c_str() + strlen("--threads="));
+        }
+        else if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(strlen("--trace="));
+        }
+        else if (arg.rfind("--serve=", 0) == 0) {
+            server.socketPath = arg.substr(strlen("--serve="));
+        }
+        else if (arg.rfind("--cached-programs=", 0) == 0) {
+            server.cacheEntries = strtoull(arg.c_str() + strlen("--cached-programs="), nullptr, 10);
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        }
+        else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (!server.socketPath.empty()) {
+        server.workers = max(1u, threads);
+        if (lineOptions.format != OutputFormat::TEXT) {
+            cerr << "--serve answers in the text format" << endl;
+        }
+        return serveLexp(server, lineOptions.foldAST);
+    }
+
+    if ((stream && !paths.empty()) || (!stream && paths.size() < 2)) {
+        cout << "Usage: ./LexpInterpreter [--fold] [--batch] [--threads=N] [--results-only] [--format=text|jsonl|binary] [--columns=FILE] [--no-simd] [--trace=FILE] <input_file> <output_file>" << endl;
+        cout << "       ./LexpInterpreter --stream [--results-only] [--format=text|jsonl|binary] [--flush-ms=N] [--fold] [--trace=FILE] < input > output" << endl;
+        cout << "       ./LexpInterpreter --serve=SOCKET [--threads=N] [--cached-programs=N] [--fold]" << endl;
         return 1;
     }
 
-    string inputFilePath = argv[1];
-    string outputFilePath = argv[2];
+    unique_ptr<Trace> trace;
+    if (!tracePath.empty()) {
+        trace = make_unique<Trace>("LexpInterpreter");
+    }
+    // every way out writes the trace, errors included
+    auto finish = [&](int status) {
+        if (trace && !trace->write(tracePath)) {
+            cerr << "Cannot write the trace to " << tracePath << endl;
+        }
+        return status;
+    };
+
+    if (stream) {
+        if (lineOptions.format == OutputFormat::BINARY) {
+            string header = binaryHeader("LEXP");
+            if (write(STDOUT_FILENO, header.data(), header.size()) != (ssize_t)header.size()) {
+                cerr << "Cannot write to the standard output" << endl;
+                return finish(1);
+            }
+        }
+        int foldedNodes = 0;
+        size_t failures = processLineStream(STDIN_FILENO, STDOUT_FILENO, flushMilliseconds, [&](string_view line, ostream& out) {
+            return interpretTracedLine(line, out, lineOptions, foldedNodes, trace.get());
+        });
+        if (lineOptions.foldAST) {
+            cerr << "Constant folding removed " << foldedNodes << " nodes" << endl;
+        }
+        if (failures > 0) {
+            cerr << failures << " lines ended in an error" << endl;
+        }
+        return finish(failures > 0 ? 1 : 0);
+    }
+
+    string inputFilePath = paths[0];
+    string outputFilePath = paths[1];
+
+    if (!columnsPath.empty()) {
+        if (lineOptions.format != OutputFormat::TEXT) {
+            cerr << "--columns writes the text format" << endl;
+        }
+        return finish(interpretColumns(inputFilePath, columnsPath, outputFilePath, useSimd, trace.get()));
+    }
+
+    if (batch) {
+        MappedFile input(inputFilePath);
+        ofstream outputFile(outputFilePath, ios::binary);
+        if (!input.isOpen() || !outputFile.is_open()) {
+            cerr << "ERROR OPENING FILE" << endl;
+            return 1;
+        }
+        if (lineOptions.format == OutputFormat::BINARY) {
+            outputFile << binaryHeader("LEXP");
+        }
+        atomic<int> foldedNodes{0};
+        size_t failures = processLinesInParallel(input.text(), threads, [&](string_view line, ostream& out) {
+            int folded = 0;
+            bool ok = interpretTracedLine(line, out, lineOptions, folded, trace.get());
+            foldedNodes += folded;
+            return ok;
+        }, outputFile);
+        if (lineOptions.foldAST) {
+            cerr << "Constant folding removed " << foldedNodes << " nodes" << endl;
+        }
+        if (failures > 0) {
+            cerr << failures << " lines ended in an error" << endl;
+        }
+        return finish(failures > 0 ? 1 : 0);
+    }
+
     ifstream inputFile(inputFilePath);
-    ofstream outputFile(outputFilePath);
+    ofstream outputFile(outputFilePath, lineOptions.format == OutputFormat::TEXT ? ios::out : ios::out | ios::binary);
 
     if (!inputFile.is_open() || !outputFile.is_open()) {
         cerr << "ERROR OPENING FILE" << endl;
         return 1;
     }
+    if (lineOptions.format == OutputFormat::BINARY) {
+        outputFile << binaryHeader("LEXP");
+    }
 
+    int foldedNodes = 0;
     string line;
     while (getline(inputFile, line)) {
-        if (isOnlyWhiteSpace(line))
-        {
-            continue;
-        }
-        vector<Token> tokens = scanLine(line);
-        outputFile << "Tokens:" << endl;
-        for (const Token &token : tokens)
-        {
-            if (token.type == "ERROR READING")
-            {
-                outputFile << "ERROR READING: \"" + token.value + "\""  << endl;
-                exit(1);
-            }
-            else
-            {
-                outputFile << token.value << ": " << token.type << endl;
-            }
-        }
-        outputFile << endl;
-        
-        TokenStream ts(tokens);
-        shared_ptr<ASTnode> root = parseExpression(ts, outputFile);
-        Token nextToken = ts.peek();
-        if (nextToken.type != "End of File") {
-            outputFile << "ERROR IN PARSER: Unexpected token after expression: " << nextToken.value << endl;
-            outputFile << endl;
+        if (!interpretTracedLine(line, outputFile, lineOptions, foldedNodes, trace.get())) {
             outputFile.close();
-            exit(1);
-        }
-        
-        outputFile << "AST:" << endl;
-        printAST(root, outputFile);
-        
-        try {
-            int result = evaluateAST(root);
-            outputFile << "Result: " << result << endl;
-            outputFile << endl;
-        } catch (const exception &e) {
-            outputFile << "Evaluation Error: " << e.what() << endl;
-            exit(1);
+            exit(finish(1));
         }
     }
     
+    if (lineOptions.foldAST) {
+        cerr << "Constant folding removed " << foldedNodes << " nodes" << endl;
+    }
+
     inputFile.close();
     outputFile.close();
-    return 0;
+    return finish(0);
 }
@@ -0,0 +1,82 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Optimizer for Lexp
+Description: This module folds the constant parts of a Lexp AST before it is evaluated.
+             Children always come before their parents in the arena, so one pass in index
+             order folds a whole constant subtree bottom-up.
+             Unlike Limp, an expression containing an identifier can only end in an error,
+             and which error depends on its shape, so identities such as x + 0 are not applied.
+*/
+
+#include "LexpOptimizer.h"
+#include "LexpArithmetic.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static bool isConstant(const ASTnode& node) {
+    return node.kind == NodeKind::NUMBER && !node.literalTooLarge;
+}
+
+/*
+Drops the nodes that folding cut off from the tree. The remaining nodes keep their relative
+order, so the arena stays in post-order (see AST). Returns how many nodes were removed.
+*/
+static int removeUnreachableNodes(AST& ast) {
+    size_t before = ast.nodes.size();
+    vector<uint8_t> reachable(before, 0);
+    reachable[ast.root] = 1;
+    for (NodeId id = ast.root + 1; id-- > 0;) {
+        if (reachable[id] && ast[id].left != NO_NODE) {
+            reachable[ast[id].left] = 1;
+            reachable[ast[id].right] = 1;
+        }
+    }
+    vector<NodeId> newIndex(before, NO_NODE);
+    NodeId next = 0;
+    for (NodeId id = 0; id < before; id++) {
+        if (!reachable[id]) {
+            continue;
+        }
+        ASTnode node = ast[id];
+        if (node.left != NO_NODE) {
+            node.left = newIndex[node.left];
+            node.right = newIndex[node.right];
+        }
+        newIndex[id] = next;
+        ast[next++] = node;
+    }
+    ast.nodes.resize(next);
+    ast.root = newIndex[ast.root];
+    return (int)(before - next);
+}
+
+int foldConstants(AST& ast) {
+    if (ast.root == NO_NODE) {
+        return 0;
+    }
+    for (NodeId id = 0; id < ast.nodes.size(); id++) {
+        ASTnode& node = ast[id];
+        if (node.kind == NodeKind::NUMBER || node.kind == NodeKind::IDENTIFIER) {
+            continue;
+        }
+        const ASTnode& left = ast[node.left];
+        const ASTnode& right = ast[node.right];
+        if (!isConstant(left) || !isConstant(right)) {
+            continue;
+        }
+        if (node.kind == NodeKind::DIVIDE && right.value == 0) {
+            continue;
+        }
+        int value = node.kind == NodeKind::PLUS    ? lexpAdd(left.value, right.value)
+                    : node.kind == NodeKind::MINUS ? lexpSubtract(left.value, right.value)
+                    : node.kind == NodeKind::TIMES ? lexpMultiply(left.value, right.value)
+                                                   : lexpDivide(left.value, right.value);
+        node.kind = NodeKind::NUMBER;
+        node.value = value;
+        node.left = node.right = NO_NODE;
+        node.symbol = ast.intern(to_string(value));
+    }
+    return removeUnreachableNodes(ast);
+}
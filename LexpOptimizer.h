@@ -0,0 +1,14 @@
+#ifndef LEXP_OPTIMIZER_H
+#define LEXP_OPTIMIZER_H
+
+#include "LexpParser.h"
+
+/*
+Replaces every subexpression made only of literals by its value, computed with the
+evaluator's own arithmetic (LexpArithmetic.h). Divisions by zero and literals too large
+for an int are left in place so they still fail when the expression is evaluated.
+The folded-away nodes are removed from the arena; returns how many there were.
+*/
+int foldConstants(AST& ast);
+
+#endif
@@ -6,11 +6,11 @@ Description: This program implements a parser module for Lexp.
              according to the language grammar.  
              The output of the parser is an Abstract Syntax Tree (AST) (a preorder traverse)
              that represents the parsed code structure.  
+             Neither parsing nor printing recurses, so arbitrarily deep nesting is fine.
 */
 
-#include "LexpScanner.h"
+#include "LexpParser.h"
 #include <iostream>
-#include <regex>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -21,45 +21,6 @@ Description: This program implements a parser module for Lexp.
 
 using namespace std;
 
-struct ASTnode {
-    string value;
-    string type;
-    shared_ptr<ASTnode> left;
-    shared_ptr<ASTnode> right;
-
-    ASTnode(string val, string t, shared_ptr<ASTnode> l = nullptr, shared_ptr<ASTnode> r = nullptr)
-        : value(val), type(t) ,left(l), right(r) {}
-};
-
-class TokenStream {
-    public:
-        vector<Token> tokens;
-        size_t index = 0;
-
-        TokenStream(vector<Token> token) : tokens(std::move(token)) {}
-        // move(token) transfer token's contents to tokens without copying
-        // it allows resources to be moved instead of copied
-        // after the move, token is left in a valid but unspecified state
-
-        Token peek() {
-            if (index < tokens.size()) {
-                return tokens[index]; // return the current token
-            }
-            else {
-                return Token{"End of File", ""};
-            }
-        }
-
-        Token get() {
-            if (index < tokens.size()) {
-                return tokens[index++]; // return the current token then increase the index by 1
-            }
-            else {
-                return Token{"End of File", ""};
-            }
-        }
-};
-
 /*
 Grammar for Lexp:
 expression ::= term { + term }
@@ -69,72 +30,148 @@ piece ::= element { * element }
 element ::= ( expression ) | NUMBER | IDENTIFIER
 */
 
-shared_ptr<ASTnode> parseExpression(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseTerm(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseFactor(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parsePiece(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseElement(TokenStream& tokens, ofstream& outputFile);
-
-shared_ptr<ASTnode> parseExpression(TokenStream& tokens, ofstream& outputFile) {
-    auto node = parseTerm(tokens, outputFile);
-    while (tokens.peek().value == "+") {
-        tokens.get();
-        node = make_shared<ASTnode>("+", "SYMBOL", node, parseTerm(tokens, outputFile));
+/*
+The grammar is parsed by precedence climbing with explicit stacks instead of one recursive
+call per level and per parenthesis, so nesting is only limited by memory. Each rule above is
+a left-associative level, from + (lowest) to * (highest), and this builds exactly the tree
+the rules describe. Nodes are created in the same order too: an operator node right after
+its right operand is complete, which keeps the arena in post-order (see AST).
+*/
+
+static int precedence(TokenCode code) {
+    switch (code) {
+        case TokenCode::PLUS: return 1;
+        case TokenCode::MINUS: return 2;
+        case TokenCode::DIVIDE: return 3;
+        case TokenCode::TIMES: return 4;
+        default: return 0;
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseTerm(TokenStream& tokens, ofstream& outputFile) {
-    auto node = parseFactor(tokens, outputFile);
-    while (tokens.peek().value == "-") {
-        tokens.get();
-        node = make_shared<ASTnode>("-", "SYMBOL", node, parseFactor(tokens, outputFile));
+static NodeKind operatorKind(TokenCode code) {
+    switch (code) {
+        case TokenCode::PLUS: return NodeKind::PLUS;
+        case TokenCode::MINUS: return NodeKind::MINUS;
+        case TokenCode::DIVIDE: return NodeKind::DIVIDE;
+        default: return NodeKind::TIMES;
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseFactor(TokenStream& tokens, ofstream& outputFile) {
-    auto node = parsePiece(tokens, outputFile);
-    while (tokens.peek().value == "/") {
-        tokens.get();
-        node = make_shared<ASTnode>("/", "SYMBOL", node, parsePiece(tokens, outputFile));
+NodeId parseExpression(TokenStream& tokens, AST& ast) {
+    // an operator waiting for its right operand, or an open parenthesis (precedence 0)
+    struct Pending {
+        TokenCode code;
+        int precedence;
+        string_view text;
+    };
+    // kept from one call to the next (one pair per thread), so parsing line after line allocates nothing once they have grown
+    static thread_local vector<Pending> pending;
+    static thread_local vector<NodeId> operands;
+    pending.clear();
+    operands.clear();
+
+    // replaces the two operands on top of the stack by the operator node joining them
+    auto reduce = [&]() {
+        NodeId right = operands.back();
+        operands.pop_back();
+        operands.back() = ast.addNode(operatorKind(pending.back().code), operands.back(), right);
+        pending.pop_back();
+    };
+
+    for (;;) {
+        // element ::= ( expression ) | NUMBER | IDENTIFIER
+        Token token = tokens.get();
+        if (token.code == TokenCode::LPAREN) {
+            pending.push_back(Pending{TokenCode::LPAREN, 0, token.value});
+            continue;
+        }
+        if (token.kind == TokenKind::NUMBER) {
+            operands.push_back(ast.addNumber(token.value));
+        } else if (token.kind == TokenKind::IDENTIFIER) {
+            operands.push_back(ast.addIdentifier(token.value));
+        } else {
+            throw ParseError("ERROR IN PARSER: Unexpected token: " + string(token.value));
+        }
+
+        // after an operand: an operator continues the expression, anything else ends it
+        for (;;) {
+            int level = precedence(tokens.peek().code);
+            if (level > 0) {
+                while (!pending.empty() && pending.back().precedence >= level) {
+                    reduce();
+                }
+                pending.push_back(Pending{tokens.get().code, level, ""});
+                break;
+            }
+            while (!pending.empty() && pending.back().precedence > 0) {
+                reduce();
+            }
+            if (pending.empty()) {
+                return operands.back();
+            }
+            // the innermost parenthesized expression is complete
+            if (tokens.get().code != TokenCode::RPAREN) {
+                throw ParseError("ERROR IN PARSER: Expected closing parenthesis but only found: " + string(pending.back().text));
+            }
+            pending.pop_back();
+        }
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parsePiece(TokenStream& tokens, ofstream& outputFile) {
-    auto node = parseElement(tokens, outputFile);
-    while (tokens.peek().value == "*") {
-        tokens.get();
-        node = make_shared<ASTnode>("*", "SYMBOL", node, parseElement(tokens, outputFile));
+static string_view nodeSymbol(NodeKind kind) {
+    switch (kind) {
+        case NodeKind::PLUS: return "+";
+        case NodeKind::MINUS: return "-";
+        case NodeKind::TIMES: return "*";
+        case NodeKind::DIVIDE: return "/";
+        default: return "";
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseElement(TokenStream& tokens, ofstream& outputFile) {
-    Token token = tokens.get();
-    if (token.type == "NUMBER" || token.type == "IDENTIFIER") {
-        return make_shared<ASTnode>(token.value, token.type);
-    } else if (token.value == "(") {
-        auto node = parseExpression(tokens, outputFile);
-        if (tokens.get().value != ")") {
-            outputFile << "ERROR IN PARSER: Expected closing parenthesis but only found: " << token.value << endl;
-            outputFile.close();
-            exit(1);
+void forEachASTLine(const AST& ast, NodeId node, const function<void(const ASTLine&)>& visit, int depth) {
+    // pre-order with an explicit stack, so a deeply nested tree does not overflow the call stack
+    static thread_local vector<pair<NodeId, int>> stack; // kept, like parseExpression's stacks
+    stack.clear();
+    if (node != NO_NODE) {
+        stack.push_back({node, depth});
+    }
+    while (!stack.empty()) {
+        auto [id, level] = stack.back();
+        stack.pop_back();
+        const ASTnode& n = ast[id];
+        if (n.kind == NodeKind::NUMBER) {
+            visit(ASTLine{level, id, "NUMBER", ast.name(id)});
+        } else if (n.kind == NodeKind::IDENTIFIER) {
+            visit(ASTLine{level, id, "IDENTIFIER", ast.name(id)});
+        } else {
+            visit(ASTLine{level, id, "SYMBOL", nodeSymbol(n.kind)});
+        }
+        // right first, so the left subtree is printed first
+        if (n.right != NO_NODE) {
+            stack.push_back({n.right, level + 1});
+        }
+        if (n.left != NO_NODE) {
+            stack.push_back({n.left, level + 1});
         }
-        return node;
     }
-
-    outputFile << "ERROR IN PARSER: Unexpected token: " << token.value << endl;
-    outputFile.close();
-    exit(1);
 }
 
-void printAST(const shared_ptr<ASTnode>& node, ofstream& outputFile, int depth = 0) {
-    if (!node) return;
-    outputFile << string(depth * 2, ' ') << node->value << " : " << node->type << endl;
-    printAST(node->left, outputFile, depth + 1);
-    printAST(node->right, outputFile, depth + 1);
+void printAST(const AST& ast, NodeId node, ostream& outputFile, int depth) {
+    // the lines go straight into the stream's buffer: formatting them through the ostream costs more than the rest of a line
+    streambuf& out = *outputFile.rdbuf();
+    auto put = [&](string_view text) { out.sputn(text.data(), (streamsize)text.size()); };
+    static const char blanks[] = "                                ";
+    forEachASTLine(ast, node, [&](const ASTLine& line) {
+        for (size_t indent = (size_t)line.depth * 2; indent > 0;) {
+            size_t part = min(indent, sizeof(blanks) - 1);
+            put(string_view(blanks, part));
+            indent -= part;
+        }
+        put(line.text);
+        // the rest of the line in one piece
+        NodeKind kind = ast[line.node].kind;
+        put(kind == NodeKind::NUMBER ? " : NUMBER\n" : kind == NodeKind::IDENTIFIER ? " : IDENTIFIER\n" : " : SYMBOL\n");
+    }, depth);
 }
 
 /*
@@ -175,22 +212,29 @@ int main(int argc, char *argv[])
 
         for (const Token &token : tokens)
         {
-            if (token.type == "ERROR READING")
+            if (token.kind == TokenKind::ERROR)
             {
-                outputFile << "ERROR READING: \"" + token.value + "\""  << endl;
+                outputFile << "ERROR READING: \"" << token.value << "\""  << endl;
             }
             else
             {
-                outputFile << token.value << ": " << token.type << endl;
+                outputFile << token.value << ": " << tokenKindName(token.kind) << endl;
             }
         }
 
         outputFile << endl;
 
         TokenStream ts(tokens);
-        shared_ptr<ASTnode> root = parseExpression(ts, outputFile);
+        AST ast;
+        try {
+            ast.root = parseExpression(ts, ast);
+        } catch (const ParseError& e) {
+            outputFile << e.what() << endl;
+            outputFile.close();
+            exit(1);
+        }
         Token nextToken = ts.peek();
-        if (nextToken.type != "End of File") {
+        if (nextToken.kind != TokenKind::END_OF_FILE) {
             outputFile << "ERROR IN PARSER: Unexpected token after expression: " << nextToken.value << endl;
             outputFile << endl;
             outputFile.close();
@@ -198,7 +242,7 @@ int main(int argc, char *argv[])
         }
 
         outputFile << "AST:" << endl;
-        printAST(root, outputFile);
+        printAST(ast, ast.root, outputFile);
         outputFile << endl;
     }
 
@@ -4,19 +4,130 @@
 #include "LexpScanner.h"
 #include <string>
 #include <vector>
-#include <memory>
-#include <fstream>
+#include <string_view>
+#include <ostream>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
+// Nodes refer to each other by their index in AST::nodes
+typedef uint32_t NodeId;
+const NodeId NO_NODE = UINT32_MAX;
+
+enum class NodeKind : uint8_t {
+    NUMBER,
+    IDENTIFIER,
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE
+};
+
 struct ASTnode {
-    string value;
-    string type;
-    shared_ptr<ASTnode> left;
-    shared_ptr<ASTnode> right;
+    NodeKind kind;
+    bool literalTooLarge; // NUMBER whose digits do not fit in an int
+    uint32_t symbol;      // NUMBER and IDENTIFIER: index of the spelling in AST::names
+    int32_t value;        // NUMBER: the literal, parsed once by the parser
+    NodeId left;
+    NodeId right;
+};
+
+/*
+The nodes of an expression live contiguously in one vector and refer to their children
+by index, so parsing a line costs no allocation per node. Identifier names and number
+spellings are interned into names. Children are always created before their parent,
+and the left operand before the right one, and every node is part of the tree, so
+the nodes are in post-order and root is the last of them.
+*/
+class AST {
+    public:
+        vector<ASTnode> nodes;
+        vector<string> names;
+        /*
+        Open-addressing hash table of symbols (indices into names), EMPTY where free. Looking a
+        spelling up compares it with names directly, so interning a name seen before allocates nothing.
+        */
+        vector<uint32_t> nameTable;
+        NodeId root = NO_NODE;
+
+        const ASTnode& operator[](NodeId id) const { return nodes[id]; }
+        ASTnode& operator[](NodeId id) { return nodes[id]; }
+
+        NodeId addNode(NodeKind kind, NodeId left = NO_NODE, NodeId right = NO_NODE) {
+            nodes.push_back(ASTnode{kind, false, 0, 0, left, right});
+            return (NodeId)(nodes.size() - 1);
+        }
+
+        NodeId addIdentifier(string_view name) {
+            NodeId id = addNode(NodeKind::IDENTIFIER);
+            nodes[id].symbol = intern(name);
+            return id;
+        }
+
+        NodeId addNumber(string_view digits) {
+            NodeId id = addNode(NodeKind::NUMBER);
+            int64_t value = 0;
+            for (char c : digits) {
+                value = value * 10 + (c - '0');
+                if (value > INT32_MAX) {
+                    nodes[id].literalTooLarge = true;
+                    break;
+                }
+            }
+            nodes[id].value = (int32_t)value;
+            nodes[id].symbol = intern(digits);
+            return id;
+        }
+
+        uint32_t intern(string_view text) {
+            if (names.size() * 2 >= nameTable.size()) {
+                growNameTable();
+            }
+            size_t mask = nameTable.size() - 1;
+            for (size_t i = hash<string_view>()(text) & mask;; i = (i + 1) & mask) {
+                uint32_t symbol = nameTable[i];
+                if (symbol == EMPTY) {
+                    nameTable[i] = (uint32_t)names.size();
+                    names.emplace_back(text);
+                    return nameTable[i];
+                }
+                if (names[symbol] == text) {
+                    return symbol;
+                }
+            }
+        }
+
+        const string& name(NodeId id) const { return names[nodes[id].symbol]; }
 
-    ASTnode(string val, string t, shared_ptr<ASTnode> l = nullptr, shared_ptr<ASTnode> r = nullptr)
-        : value(val), type(t) ,left(l), right(r) {}
+        /*
+        Empties the tree but keeps the memory of its vectors, so parsing the next line into it
+        allocates nothing unless that line is larger. The name table goes back to its smallest
+        size, so one long line does not make clearing it slow for every line after it.
+        */
+        void clear() {
+            nodes.clear();
+            names.clear();
+            nameTable.assign(min<size_t>(nameTable.size(), 16), EMPTY);
+            root = NO_NODE;
+        }
+
+    private:
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+        void growNameTable() {
+            nameTable.assign(max<size_t>(16, nameTable.size() * 2), EMPTY);
+            size_t mask = nameTable.size() - 1;
+            for (uint32_t symbol = 0; symbol < names.size(); symbol++) {
+                size_t i = hash<string_view>()(names[symbol]) & mask;
+                while (nameTable[i] != EMPTY) {
+                    i = (i + 1) & mask;
+                }
+                nameTable[i] = symbol;
+            }
+        }
 };
 
 class TokenStream {
@@ -34,7 +145,7 @@ class TokenStream {
                 return tokens[index]; // return the current token
             }
             else {
-                return Token{"End of File", ""};
+                return Token{TokenKind::END_OF_FILE, TokenCode::NONE, ""};
             }
         }
 
@@ -43,17 +154,33 @@ class TokenStream {
                 return tokens[index++]; // return the current token then increase the index by 1
             }
             else {
-                return Token{"End of File", ""};
+                return Token{TokenKind::END_OF_FILE, TokenCode::NONE, ""};
             }
         }
 };
 
-shared_ptr<ASTnode> parseExpression(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseTerm(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseFactor(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parsePiece(TokenStream& tokens, ofstream& outputFile);
-shared_ptr<ASTnode> parseElement(TokenStream& tokens, ofstream& outputFile);
+/*
+A syntax error. what() is the "ERROR IN PARSER: ..." line to report; the caller decides
+whether that ends the whole run or only the current line.
+*/
+class ParseError : public runtime_error {
+    public:
+        explicit ParseError(const string& message) : runtime_error(message) {}
+};
+
+NodeId parseExpression(TokenStream& tokens, AST& ast);
+
+// One line of printAST: "text : type" at depth (the operators are of type SYMBOL)
+struct ASTLine {
+    int depth;
+    NodeId node;
+    string_view type;
+    string_view text;
+};
+
+// Calls visit with every line printAST writes for the tree under node, in the same order
+void forEachASTLine(const AST& ast, NodeId node, const function<void(const ASTLine&)>& visit, int depth = 0);
 
-void printAST(const shared_ptr<ASTnode>& node, ofstream& outputFile, int depth = 0);
+void printAST(const AST& ast, NodeId node, ostream& outputFile, int depth = 0);
 
 #endif 
@@ -5,83 +5,130 @@ Description: This program implements a lexical scanner for Lexp,
             identifying identifiers, numbers, and symbols.
 */
 
+#include "LexpScanner.h"
 #include <iostream>
-#include <regex>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <cctype>
 #include <algorithm>
 #include <memory>
+#include <array>
 
 using namespace std;
 
-const regex IDENTIFIER_REGEX("^[a-zA-Z][a-zA-Z0-9]*");
-const regex NUMBER_REGEX("^[0-9]+");
-const regex SYMBOL_REGEX("^[+\\-*/()]");
-const regex WHITESPACE_REGEX(R"(\s+)");
-
-struct Token {
-    string type;
-    string value;
+/*
+Hand-written DFA scanner: each byte is classified once through CHAR_CLASS and
+a token ends as soon as a byte of a different class is seen, so a line is scanned
+in a single forward pass instead of one regex_search per token over the remaining text.
+*/
+enum CharClass : unsigned char {
+    CC_OTHER,
+    CC_SPACE,
+    CC_LETTER,
+    CC_DIGIT,
+    CC_SYMBOL // + - * / ( )
 };
 
-bool isOnlyWhiteSpace(const string& line)
+static constexpr array<unsigned char, 256> makeCharClassTable()
+{
+    array<unsigned char, 256> table{};
+    for (int c = 'a'; c <= 'z'; c++) table[c] = CC_LETTER;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] = CC_LETTER;
+    for (int c = '0'; c <= '9'; c++) table[c] = CC_DIGIT;
+    // same set as the \s class used by the old WHITESPACE_REGEX
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) table[(unsigned char)c] = CC_SPACE;
+    for (char c : {'+', '-', '*', '/', '(', ')'}) table[(unsigned char)c] = CC_SYMBOL;
+    return table;
+}
+
+static constexpr array<unsigned char, 256> CHAR_CLASS = makeCharClassTable();
+
+static constexpr array<TokenCode, 256> makeSymbolCodeTable()
+{
+    array<TokenCode, 256> table{};
+    table[(unsigned char)'+'] = TokenCode::PLUS;
+    table[(unsigned char)'-'] = TokenCode::MINUS;
+    table[(unsigned char)'*'] = TokenCode::TIMES;
+    table[(unsigned char)'/'] = TokenCode::DIVIDE;
+    table[(unsigned char)'('] = TokenCode::LPAREN;
+    table[(unsigned char)')'] = TokenCode::RPAREN;
+    return table;
+}
+
+static constexpr array<TokenCode, 256> SYMBOL_CODE = makeSymbolCodeTable();
+
+const char* tokenKindName(TokenKind kind)
+{
+    switch (kind) {
+        case TokenKind::IDENTIFIER: return "IDENTIFIER";
+        case TokenKind::NUMBER: return "NUMBER";
+        case TokenKind::SYMBOL: return "SYMBOL";
+        case TokenKind::ERROR: return "ERROR READING";
+        case TokenKind::END_OF_FILE: return "End of File";
+    }
+    return "";
+}
+
+bool isOnlyWhiteSpace(string_view line)
 {
     return all_of(line.begin(), line.end(), [](char c) { return isspace(c); });
 }
 
-vector<Token> scanLine(const string& line)
+vector<Token> scanLine(string_view line)
 {
     vector<Token> tokens;
+    scanLine(line, tokens);
+    return tokens;
+}
+
+void scanLine(string_view line, vector<Token>& tokens)
+{
+    tokens.clear();
+    const char* text = line.data();
+    size_t length = line.length();
     size_t index = 0;
 
-    while (index < line.length())
+    while (index < length)
     {
-        char currChar = line[index];
-        string remaining = line.substr(index);
-        string token;
-        smatch match;
-        size_t tokenLength = 0;
+        size_t start = index;
+        unsigned char charClass = CHAR_CLASS[(unsigned char)text[index]];
 
-        if (regex_search(remaining, match, WHITESPACE_REGEX) && match.position() == 0)
+        if (charClass == CC_SPACE)
         {
-            tokenLength = match.length();
-            index += match.length();
-            continue;
+            while (index < length && CHAR_CLASS[(unsigned char)text[index]] == CC_SPACE)
+            {
+                index++;
+            }
         }
-        else if (regex_search(remaining, match, IDENTIFIER_REGEX))
+        else if (charClass == CC_LETTER)
         {
-            tokenLength = match.length();
-            token = match.str();
-            tokens.push_back({"IDENTIFIER", token});
+            while (index < length && (CHAR_CLASS[(unsigned char)text[index]] == CC_LETTER
+                                      || CHAR_CLASS[(unsigned char)text[index]] == CC_DIGIT))
+            {
+                index++;
+            }
+            tokens.push_back({TokenKind::IDENTIFIER, TokenCode::NONE, string_view(text + start, index - start)});
         }
-        else if (regex_search(remaining, match, NUMBER_REGEX))
+        else if (charClass == CC_DIGIT)
         {
-            tokenLength = match.length();
-            token = match.str();
-            tokens.push_back({"NUMBER", token});
+            while (index < length && CHAR_CLASS[(unsigned char)text[index]] == CC_DIGIT)
+            {
+                index++;
+            }
+            tokens.push_back({TokenKind::NUMBER, TokenCode::NONE, string_view(text + start, index - start)});
         }
-        else if (regex_search(remaining, match, SYMBOL_REGEX))
+        else if (charClass == CC_SYMBOL)
         {
-            tokenLength = match.length();
-            token = match.str();
-            tokens.push_back({"SYMBOL", token});
+            index++;
+            tokens.push_back({TokenKind::SYMBOL, SYMBOL_CODE[(unsigned char)text[start]], string_view(text + start, 1)});
         }
         else
         {
-            tokenLength = 1;
-            tokens.push_back({"ERROR READING", string(1, currChar)});
+            tokens.push_back({TokenKind::ERROR, TokenCode::NONE, string_view(text + start, 1)});
             break;
         }
-        /*
-        when nothing matches, the length of match is 0
-        ensure index always move forward
-        */
-       index += match.length() > 0 ? match.length() : 1;
     }
-
-    return tokens;
 }
 
 /*
@@ -118,13 +165,13 @@ int main(int argc, char *argv[])
 
         for (const Token &token : tokens)
         {
-            if (token.type == "ERROR READING")
+            if (token.kind == TokenKind::ERROR)
             {
-                outputFile << "ERROR READING: \"" + token.value + "\""  << endl;
+                outputFile << "ERROR READING: \"" << token.value << "\""  << endl;
             }
             else
             {
-                outputFile << token.value << ": " << token.type << endl;
+                outputFile << token.value << ": " << tokenKindName(token.kind) << endl;
             }
         }
 
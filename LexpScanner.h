@@ -3,14 +3,46 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 
+enum class TokenKind : uint8_t {
+    IDENTIFIER,
+    NUMBER,
+    SYMBOL,
+    ERROR,       // printed as "ERROR READING"
+    END_OF_FILE  // returned by TokenStream past the last token
+};
+
+// Which symbol a token is, so the parser never compares strings
+enum class TokenCode : uint8_t {
+    NONE,
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE,
+    LPAREN,
+    RPAREN
+};
+
+/*
+A token does not own its text: value is a view into the line that was passed
+to scanLine, so that line has to stay alive for as long as the tokens are used.
+*/
 struct Token {
-    std::string type;
-    std::string value;
+    TokenKind kind;
+    TokenCode code;
+    std::string_view value;
 };
 
-bool isOnlyWhiteSpace(const std::string& line);
+// The names used in the token dumps ("IDENTIFIER", "ERROR READING", ...)
+const char* tokenKindName(TokenKind kind);
+
+bool isOnlyWhiteSpace(std::string_view line);
+
+std::vector<Token> scanLine(std::string_view line);
 
-std::vector<Token> scanLine(const std::string& line);
+// The same into tokens, which is cleared first, so a caller scanning line after line can keep its memory
+void scanLine(std::string_view line, std::vector<Token>& tokens);
 
 #endif 
@@ -0,0 +1,44 @@
+#ifndef LIMP_ARITHMETIC_H
+#define LIMP_ARITHMETIC_H
+
+#include <cstdint>
+#include <stdexcept>
+
+/*
+Limp's integer operators, shared by every way of running a program so they all agree.
+Overflow wraps around (the int additions and multiplications of the evaluator have always
+compiled to wrapping machine instructions); doing the arithmetic on uint32_t makes that
+well defined instead of relying on signed overflow.
+*/
+
+inline int limpAdd(int left, int right)
+{
+    return (int)((uint32_t)left + (uint32_t)right);
+}
+
+// Negative numbers aren't supported: when the right operand is not smaller the result is 0
+inline int limpSubtract(int left, int right)
+{
+    return left > right ? (int)((uint32_t)left - (uint32_t)right) : 0;
+}
+
+inline int limpMultiply(int left, int right)
+{
+    return (int)((uint32_t)left * (uint32_t)right);
+}
+
+// Truncating division; INT_MIN / -1 wraps instead of trapping
+inline int limpDivide(int left, int right)
+{
+    if (right == 0)
+    {
+        throw std::runtime_error("Division by zero");
+    }
+    if (right == -1)
+    {
+        return (int)(0u - (uint32_t)left);
+    }
+    return left / right;
+}
+
+#endif
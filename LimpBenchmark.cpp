@@ -0,0 +1,260 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Benchmark for Limp
+Description: This program generates synthetic Limp programs (a long run of assignments, deeply
+             nested if statements and a while loop too irregular to run in closed form) and
+             measures each stage separately: scanner throughput (Scanner), parser throughput
+             (parseStatement pulling its tokens from the Scanner), AST memory and sharing, and evaluation speed of the tree Evaluator, of the
+             bytecode VirtualMachine and of the native code, and how often the tree Evaluator
+             allocates memory while it runs.
+             The results are printed as JSON (see BenchmarkReport.h); --compare=FILE compares
+             them with an earlier run and exits with 1 when one got worse than --threshold.
+*/
+
+#include "LimpParser.h"
+#include "LimpBytecode.h"
+#include "LimpJit.h"
+#include "LimpEvaluator.h"
+#include "LimpCache.h"
+#include "BenchmarkReport.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdlib>
+#include <random>
+#include <cstdio>
+#include <new>
+
+using namespace std;
+
+// Every allocation of the program, counted so an engine can be checked for allocating while it runs
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* block = malloc(size > 0 ? size : 1)) {
+        return block;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+const int VARIABLES = 64;
+
+// Assigns 1 to every variable, then statements assignments like "x5 := x12 + 7 * x3 - x40 / 9"
+static string straightLineProgram(int statements) {
+    mt19937 random(141);
+    string text;
+    for (int i = 0; i < VARIABLES; i++) {
+        text += "x" + to_string(i) + " := 1 ; ";
+    }
+    for (int i = 0; i < statements; i++) {
+        auto variable = [&]() { return "x" + to_string(random() % VARIABLES); };
+        text += variable() + " := " + variable() + " + " + to_string(random() % 100) + " * " + variable()
+              + " - " + variable() + " / " + to_string(random() % 9 + 1);
+        text += i + 1 < statements ? " ; " : "";
+    }
+    return text;
+}
+
+// depth if statements each nested in the then branch of the one before
+static string nestedIfProgram(int depth) {
+    string text = "x := 1 ; y := 0 ; ";
+    for (int i = 0; i < depth; i++) {
+        text += "if x + " + to_string(i % 7) + " then y := y + 1 ; ";
+    }
+    text += "skip";
+    for (int i = 0; i < depth; i++) {
+        text += " else y := y - 1 endif";
+    }
+    return text;
+}
+
+/*
+A loop of trips iterations whose body multiplies and divides by the counter, which LimpLoops
+cannot run in closed form, so every engine runs it one iteration at a time.
+*/
+static string whileLoopProgram(int trips) {
+    return "i := 0 ; s := 0 ; while " + to_string(trips) + " - i do s := s + i * 3 / (i + 1) ; i := i + 1 endwhile";
+}
+
+// Bytes held by the tree: the node arena, the statements of the blocks, the interned spellings and the two hash tables
+static size_t astBytes(const AST& ast) {
+    size_t bytes = ast.nodes.capacity() * sizeof(ASTnode) + ast.blocks.capacity() * sizeof(NodeId)
+                 + ast.nameTable.capacity() * sizeof(uint32_t) + ast.nodeTable.capacity() * sizeof(NodeId);
+    for (const string& name : ast.names) {
+        bytes += sizeof(string) + (name.capacity() > 15 ? name.capacity() : 0);
+    }
+    return bytes;
+}
+
+/*
+The nodes the tree would have if no expression were shared, as it is printed: every node counts
+once for each place it is used. Children come before their parents, so one pass adds them up.
+*/
+static double treeNodes(const AST& ast) {
+    vector<double> size(ast.nodes.size(), 0);
+    for (NodeId id = 0; id < ast.nodes.size(); id++) {
+        const ASTnode& node = ast[id];
+        size[id] = 1;
+        for (NodeId child : {node.left, node.right, node.extra}) {
+            size[id] += child != NO_NODE ? size[child] : 0;
+        }
+        if (node.kind == NodeKind::SEQUENCE) {
+            for (NodeId statement : ast.block(id)) {
+                size[id] += size[statement];
+            }
+        }
+    }
+    return ast.root != NO_NODE ? size[ast.root] : 0;
+}
+
+static size_t countTokens(const string& text) {
+    Scanner scanner(text);
+    size_t count = 0;
+    while (scanner.next().kind != TokenKind::END_OF_FILE) {
+        count++;
+    }
+    return count;
+}
+
+static AST parseText(const string& text, function<void(const Token&)> onToken = nullptr) {
+    Scanner scanner(text);
+    TokenStream ts(scanner, std::move(onToken)); // generated programs have no syntax errors
+    AST ast;
+    ast.root = parseStatement(ts, ast);
+    return ast;
+}
+
+static map<string, int> runTree(const AST& ast) {
+    Evaluator evaluator(ast);
+    evaluator.evaluate();
+    return evaluator.getMemory();
+}
+
+static map<string, int> runVirtualMachine(const Bytecode& bytecode) {
+    VirtualMachine vm(bytecode);
+    vm.run();
+    return vm.getMemory();
+}
+
+static map<string, int> runNative(const Bytecode& bytecode) {
+    NativeProgram native(bytecode);
+    native.run();
+    return native.getMemory();
+}
+
+/*
+What --cache saves at startup: a cold run scans and parses the program, going through the
+token list as it is scanned, a cached run reads the token list and the AST from the cache file.
+*/
+static void benchmarkStartup(BenchmarkReport& report, const string& workload, const string& text, int callsPerBatch) {
+    const string path = "LimpBenchmark.limpc";
+    vector<CachedToken> tokens;
+    AST ast = parseText(text, [&](const Token& token) {
+        tokens.push_back(CachedToken{(uint32_t)(token.value.data() - text.data()), (uint32_t)token.value.size(), token.kind});
+    });
+    if (!writeProgramCache(path, text, tokens, ast)) {
+        cerr << "Cannot write " << path << endl;
+        exit(1);
+    }
+
+    volatile size_t sink = 0;
+    double cold = measureNanoseconds(5, callsPerBatch, [&]() {
+        size_t listed = 0;
+        sink = parseText(text, [&](const Token& token) { listed += token.value.size(); }).nodes.size();
+        sink = listed;
+    });
+    double cached = measureNanoseconds(5, callsPerBatch, [&]() {
+        vector<CachedToken> loadedTokens;
+        AST loaded;
+        if (!readProgramCache(path, text, loadedTokens, loaded)) {
+            cerr << workload << ": the cache was not taken" << endl;
+            exit(1);
+        }
+        sink = loaded.nodes.size();
+    });
+    (void)sink;
+    remove(path.c_str());
+
+    report.add(workload + "/cold_start", cold / 1e3, "us/program", true);
+    report.add(workload + "/cached_start", cached / 1e3, "us/program", true);
+}
+
+/*
+Every stage on one program. The front end is measured per token and per node (only when
+frontEnd is set: a short program is over before the clock ticks), the engines per unit of work,
+units being the number of statements or iterations the program runs. The engine times include
+setting the engine up, which for the native code is the translation of the bytecode.
+*/
+static void benchmarkProgram(BenchmarkReport& report, const string& workload, const string& text,
+                             double units, const string& unit, bool frontEnd, int batches) {
+    size_t tokenCount = countTokens(text);
+    AST ast = parseText(text);
+    Bytecode bytecode = compileProgram(ast);
+
+    map<string, int> expected = runTree(ast);
+    if (runVirtualMachine(bytecode) != expected || (jitSupported() && runNative(bytecode) != expected)) {
+        cerr << workload << ": the engines disagree" << endl;
+        exit(1);
+    }
+
+    volatile size_t sink = 0;
+    double scan = measureNanoseconds(batches, 1, [&]() { sink = countTokens(text); });
+    double parse = measureNanoseconds(batches, 1, [&]() { sink = parseText(text).nodes.size(); });
+    double compile = measureNanoseconds(batches, 1, [&]() { sink = compileProgram(ast).code.size(); });
+    double tree = measureNanoseconds(batches, 1, [&]() { sink = runTree(ast).size(); });
+    double vm = measureNanoseconds(batches, 1, [&]() { sink = runVirtualMachine(bytecode).size(); });
+    Evaluator counted(ast);
+    uint64_t allocationsBefore = allocations;
+    counted.evaluate();
+    uint64_t evaluatorAllocations = allocations - allocationsBefore;
+
+    if (frontEnd) {
+        // per node of the unshared tree, so the numbers compare with runs from before expressions were shared
+        double nodes = treeNodes(ast);
+        report.add(workload + "/scan", text.size() / scan * 1e3, "MB/s", false);
+        report.add(workload + "/parse", parse / tokenCount, "ns/token", true);
+        report.add(workload + "/ast_memory", astBytes(ast) / nodes, "bytes/node", true);
+        report.add(workload + "/ast_sharing", nodes / ast.nodes.size(), "nodes/allocated node", false);
+        report.add(workload + "/compile", compile / nodes, "ns/node", true);
+    }
+    report.add(workload + "/evaluator", tree / units, "ns/" + unit, true);
+    report.add(workload + "/evaluator_allocations", evaluatorAllocations / units, "allocations/" + unit, true);
+    report.add(workload + "/vm", vm / units, "ns/" + unit, true);
+    if (jitSupported()) {
+        double native = measureNanoseconds(batches, 1, [&]() { sink = runNative(bytecode).size(); });
+        report.add(workload + "/jit", native / units, "ns/" + unit, true);
+    }
+    (void)sink;
+}
+
+int main(int argc, char *argv[]) {
+    BenchmarkOptions options = parseBenchmarkOptions(argc, argv);
+    auto size = [&](int count) { return max(1, (int)(count * options.scale)); };
+
+    BenchmarkReport report("limp", options.scale);
+    int statements = size(100000);
+    benchmarkProgram(report, "straight_line", straightLineProgram(statements), VARIABLES + statements, "statement", true, 10);
+    int depth = size(50000);
+    benchmarkProgram(report, "nested_if", nestedIfProgram(depth), depth, "level", true, 10);
+    int trips = size(1000000);
+    benchmarkProgram(report, "while_loop", whileLoopProgram(trips), trips, "iteration", false, 5);
+    benchmarkStartup(report, "straight_line", straightLineProgram(statements), 1);
+    benchmarkStartup(report, "short_program", straightLineProgram(10), size(1000));
+
+    report.writeJson(cout);
+    if (!options.compareWith.empty()) {
+        return report.compare(options.compareWith, options.threshold, cerr) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Execution limits for Limp
+Description: This module keeps the fuel, the deadline and the memory limit of one run of a
+             Limp program, and stops the run with a BudgetExceeded error when one of them is
+             used up, so a loop that never ends cannot keep a machine busy forever.
+*/
+
+#include "LimpBudget.h"
+#include <string>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+
+string stoppedWhere(const BudgetExceeded &stop, const AST &ast)
+{
+    if (stop.loop == NO_NODE)
+    {
+        return " before any loop ran";
+    }
+    return " in the while loop at line " + to_string(ast[stop.loop].line) + ", column " + to_string(ast[stop.loop].column);
+}
+
+ExecutionBudget::ExecutionBudget(const ExecutionLimits &limits)
+    : limits(limits),
+      fuelGiven(limits.fuel > 0 ? limits.fuel : numeric_limits<uint64_t>::max()),
+      fuelLeft(fuelGiven)
+{
+}
+
+void ExecutionBudget::start()
+{
+    deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                                                 chrono::duration<double>(limits.seconds));
+    untilCheck = CHECK_INTERVAL;
+    check(NO_NODE);
+}
+
+void ExecutionBudget::check(NodeId loop)
+{
+    untilCheck = CHECK_INTERVAL;
+    if (limits.seconds > 0 && chrono::steady_clock::now() >= deadline)
+    {
+        exceeded(BudgetExceeded::TIME, loop);
+    }
+    if (limits.memoryBytes > 0 && memoryUsage)
+    {
+        size_t used = memoryUsage();
+        if (used > limits.memoryBytes)
+        {
+            exceeded(BudgetExceeded::MEMORY, loop, used);
+        }
+    }
+}
+
+void ExecutionBudget::exceeded(BudgetExceeded::Reason reason, NodeId loop, size_t used)
+{
+    ostringstream message;
+    switch (reason)
+    {
+    case BudgetExceeded::FUEL:
+        message << "Out of fuel after " << iterations() << " loop iterations";
+        break;
+    case BudgetExceeded::TIME:
+        message << "Time limit of " << limits.seconds << " s reached after " << iterations() << " loop iterations";
+        break;
+    case BudgetExceeded::MEMORY:
+        message << "Memory limit of " << limits.memoryBytes << " bytes reached (" << used << " bytes in use)";
+        break;
+    }
+    throw BudgetExceeded(reason, loop, message.str());
+}
@@ -0,0 +1,108 @@
+#ifndef LIMP_BUDGET_H
+#define LIMP_BUDGET_H
+
+#include "LimpParser.h"
+#include <string>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+using namespace std;
+
+// What a run may use before it is stopped; 0 means no limit
+struct ExecutionLimits
+{
+    uint64_t fuel = 0;        // loop iterations, over all loops of the program
+    double seconds = 0;       // wall-clock time from the start of the run
+    size_t memoryBytes = 0;   // working memory of the engine (variables, stacks, statements left to run)
+
+    bool any() const { return fuel > 0 || seconds > 0 || memoryBytes > 0; }
+};
+
+// Thrown by the engines when a limit is reached; the variables keep the values they had
+class BudgetExceeded : public runtime_error
+{
+public:
+    enum Reason
+    {
+        FUEL,
+        TIME,
+        MEMORY
+    };
+
+    BudgetExceeded(Reason reason, NodeId loop, const string &message)
+        : runtime_error(message), reason(reason), loop(loop) {}
+
+    Reason reason;
+    NodeId loop; // the WHILE node whose iteration was about to start, NO_NODE before any loop ran
+};
+
+// " in the while loop at line L, column C" for the loop of stop (or " before any loop ran"), to follow its message
+string stoppedWhere(const BudgetExceeded &stop, const AST &ast);
+
+/*
+The limits of one run, as the engines consume them. Every engine calls iteration once per loop
+iteration, where the body starts (the bytecode has a LOOP_BUDGET instruction there, see
+compileProgram), which costs a decrement and two compares. The clock and the memory are only
+looked at every CHECK_INTERVAL iterations, so the time limit can be overrun by as long as that
+many iterations take. Loops LimpLoops runs in closed form are finite and use no fuel.
+Programs without loops always end, so they are never stopped.
+*/
+class ExecutionBudget
+{
+public:
+    static const uint32_t CHECK_INTERVAL = 1024;
+
+    explicit ExecutionBudget(const ExecutionLimits &limits);
+
+    // How much working memory the engine uses now, for the memory limit
+    void measureMemoryWith(function<size_t()> usage) { memoryUsage = std::move(usage); }
+
+    // Starts the clock; checks the memory once before anything runs
+    void start();
+
+    void iteration(NodeId loop)
+    {
+        if (fuelLeft == 0)
+        {
+            exceeded(BudgetExceeded::FUEL, loop);
+        }
+        if (--untilCheck == 0)
+        {
+            check(loop);
+        }
+        fuelLeft--;
+    }
+
+    /*
+    For native code, which counts down on its own: the iteration that starts now as with iteration,
+    and returns how many of the following ones are paid for in advance (until the next check), so
+    the caller only calls again once they have started.
+    */
+    uint32_t grant(NodeId loop)
+    {
+        iteration(loop);
+        uint32_t granted = (uint32_t)min<uint64_t>(untilCheck - 1, fuelLeft);
+        untilCheck -= granted;
+        fuelLeft -= granted;
+        return granted;
+    }
+
+    // Loop iterations run so far
+    uint64_t iterations() const { return fuelGiven - fuelLeft; }
+
+private:
+    ExecutionLimits limits;
+    uint64_t fuelGiven;
+    uint64_t fuelLeft;
+    uint32_t untilCheck = CHECK_INTERVAL;
+    chrono::steady_clock::time_point deadline;
+    function<size_t()> memoryUsage;
+
+    void check(NodeId loop);
+    [[noreturn]] void exceeded(BudgetExceeded::Reason reason, NodeId loop, size_t used = 0);
+};
+
+#endif
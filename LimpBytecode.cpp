@@ -0,0 +1,890 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Bytecode compiler and virtual machine for Limp
+Description: This module compiles the Limp AST into a flat array of stack machine
+             instructions and runs it in a single dispatch loop.
+             Variables are resolved to numbered slots at compile time, if and while
+             statements become conditional and unconditional jumps, and the arithmetic
+             follows the same rules as the Evaluator (see LimpArithmetic.h).
+             Running a program allocates nothing after the machine is constructed.
+*/
+
+#include "LimpBytecode.h"
+#include "LimpProfiler.h"
+#include "LimpArithmetic.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+class Compiler
+{
+public:
+    Compiler(const AST &tree, bool accelerate, ProfileMode profileMode, bool budgetedLoops, bool reuse)
+        : ast(tree), slots(resolveVariables(tree)), assigned(slots.names.size(), 0), accelerateLoops(accelerate),
+          profile(profileMode), budgeted(budgetedLoops), reuseValues(reuse)
+    {
+        if (reuseValues)
+        {
+            analyzeValues();
+        }
+    }
+
+    Bytecode compile()
+    {
+        program.slotNames = slots.names;
+        compileStatement(ast.root);
+        emit(Opcode::HALT, 0);
+        if (reuseValues)
+        {
+            dropUnusedTemporaries();
+        }
+        return std::move(program);
+    }
+
+private:
+    const AST &ast;
+    Bytecode program;
+    VariableSlots slots;
+    /*
+    Slots that are assigned on every path reaching the code being compiled.
+    Reads of those slots can skip the "Undefined variable" check.
+    */
+    vector<uint8_t> assigned;
+    bool accelerateLoops;
+    ProfileMode profile;
+    bool budgeted;
+    NodeId statement = NO_NODE; // the innermost statement being compiled
+    int depth = 0;
+
+    /*
+    Value numbering (see compileProgram). Equal expressions are one node (see AST), so the node
+    is the value number of an expression, and an expression whose value is still in a temporary
+    slot is loaded from there instead of being computed again. available lists those expressions,
+    oldest first, with the variables they read as one bit per slot modulo 64 (two variables can
+    share a bit, which only forgets a value too many). It holds at most MAX_AVAILABLE of them.
+    Every expression has one temporary, so whichever path stored it last, it holds the value the
+    expression has until one of its variables is assigned. The value comes from the KEEP
+    instruction keptAt[keep], which runs on every path to where the value is available, or was
+    computed in front of a loop (keep = -1).
+    */
+    struct Available
+    {
+        NodeId expression;
+        int32_t slot;
+        uint64_t reads;
+        int32_t keep;
+    };
+    static const size_t MAX_AVAILABLE = 64;
+    bool reuseValues;
+    vector<Available> available;
+    vector<uint64_t> variables;    // expressions: the variables they read, statements: the ones they assign
+    vector<uint8_t> repeated;      // operators that more than one node refers to, whose value may be needed again
+    vector<uint8_t> isAvailable;   // per node, whether it is in available
+    vector<int32_t> temporaryOf;   // per node, its temporary slot, or -1
+    vector<uint8_t> temporaryUsed; // per temporary, whether it is ever loaded (or hoisted)
+    vector<size_t> keptAt;         // the KEEP instructions, which go again unless their value is loaded
+    vector<uint8_t> keepLoaded;    // per KEEP instruction, whether its value is loaded
+    // cannotFail's answers for the loop whose invariants are hoisted (failStamp = loopStamp)
+    vector<uint8_t> failFree;
+    vector<uint32_t> failStamp;
+    uint32_t loopStamp = 0;
+
+    int slotOf(NodeId identifier)
+    {
+        return slots.slotOf(ast, identifier);
+    }
+
+    size_t emit(Opcode op, int32_t operand)
+    {
+        program.code.push_back(Instruction{op, operand});
+        if (profile == ProfileMode::SAMPLE)
+        {
+            program.statementAt.push_back(statement);
+        }
+        return program.code.size() - 1;
+    }
+
+    void push(int count)
+    {
+        depth += count;
+        if (depth > program.maxStackDepth)
+        {
+            program.maxStackDepth = depth;
+        }
+    }
+
+    void patchJump(size_t jump)
+    {
+        program.code[jump].operand = (int32_t)program.code.size();
+    }
+
+    // The statement at node starts here; emits nothing unless the program is profiled exactly
+    void markStatement(NodeId node)
+    {
+        statement = node;
+        if (profile == ProfileMode::EXACT)
+        {
+            emit(Opcode::PROFILE_ENTER, (int32_t)node);
+        }
+    }
+
+    // The statement marked last ends here
+    void markStatementEnd()
+    {
+        if (profile == ProfileMode::EXACT)
+        {
+            emit(Opcode::PROFILE_EXIT, 0);
+        }
+    }
+
+    static uint64_t variableBit(int slot)
+    {
+        return uint64_t(1) << (slot % 64);
+    }
+
+    static bool isOperator(NodeKind kind)
+    {
+        return kind >= NodeKind::PLUS && kind <= NodeKind::DIVIDE;
+    }
+
+    // Fills variables and repeated, in one pass as every node comes after its children
+    void analyzeValues()
+    {
+        variables.assign(ast.nodes.size(), 0);
+        vector<uint8_t> references(ast.nodes.size(), 0);
+        for (NodeId id = 0; id < ast.nodes.size(); id++)
+        {
+            const ASTnode &n = ast[id];
+            auto refer = [&](NodeId child)
+            {
+                if (child != NO_NODE && references[child] < 2)
+                {
+                    references[child]++;
+                }
+            };
+            refer(n.left);
+            refer(n.right);
+            refer(n.extra);
+            switch (n.kind)
+            {
+            case NodeKind::IDENTIFIER:
+                variables[id] = variableBit(slotOf(id));
+                break;
+            case NodeKind::ASSIGN:
+                variables[id] = variableBit(slotOf(n.left));
+                break;
+            case NodeKind::IF:
+                variables[id] = variables[n.right] | variables[n.extra];
+                break;
+            case NodeKind::WHILE:
+                variables[id] = variables[n.right];
+                break;
+            case NodeKind::SEQUENCE:
+                for (NodeId statement : ast.block(id))
+                {
+                    refer(statement);
+                    variables[id] |= variables[statement];
+                }
+                break;
+            default:
+                if (isOperator(n.kind))
+                {
+                    variables[id] = variables[n.left] | variables[n.right];
+                }
+                break;
+            }
+        }
+        repeated.assign(ast.nodes.size(), 0);
+        for (NodeId id = 0; id < ast.nodes.size(); id++)
+        {
+            repeated[id] = isOperator(ast[id].kind) && references[id] >= 2;
+        }
+        isAvailable.assign(ast.nodes.size(), 0);
+        temporaryOf.assign(ast.nodes.size(), -1);
+        failFree.assign(ast.nodes.size(), 0);
+        failStamp.assign(ast.nodes.size(), 0);
+    }
+
+    // The values that read a variable of mask are no longer available
+    void forget(uint64_t mask)
+    {
+        available.erase(remove_if(available.begin(), available.end(),
+                                  [&](const Available &value)
+                                  {
+                                      bool changed = (value.reads & mask) != 0;
+                                      isAvailable[value.expression] = !changed;
+                                      return changed;
+                                  }),
+                        available.end());
+    }
+
+    // Makes values the available ones, as they were at a point the code being compiled follows
+    void restoreAvailable(vector<Available> values)
+    {
+        for (const Available &value : available)
+        {
+            isAvailable[value.expression] = 0;
+        }
+        available = std::move(values);
+        for (const Available &value : available)
+        {
+            isAvailable[value.expression] = 1;
+        }
+    }
+
+    // Copies the value on top of the stack into the temporary of expression; hoisted pops it, otherwise it stays
+    void keepValue(NodeId expression, bool hoisted)
+    {
+        if (temporaryOf[expression] < 0)
+        {
+            temporaryOf[expression] = (int32_t)(slots.names.size() + temporaryUsed.size());
+            temporaryUsed.push_back(0);
+        }
+        int32_t slot = temporaryOf[expression];
+        int32_t keep = -1;
+        if (hoisted)
+        {
+            temporaryUsed[slot - slots.names.size()] = 1;
+            emit(Opcode::STORE, slot);
+            push(-1);
+        }
+        else
+        {
+            keep = (int32_t)keptAt.size();
+            keptAt.push_back(emit(Opcode::KEEP, slot));
+            keepLoaded.push_back(0);
+        }
+        if (available.size() == MAX_AVAILABLE)
+        {
+            isAvailable[available.front().expression] = 0;
+            available.erase(available.begin());
+        }
+        available.push_back(Available{expression, slot, variables[expression], keep});
+        isAvailable[expression] = 1;
+    }
+
+    /*
+    Whether evaluating the expression in front of the loop being hoisted from can raise no error:
+    its variables are assigned on every path there, it has no literal too large for an int, and it
+    divides only by literals other than 0.
+    */
+    bool cannotFail(NodeId root)
+    {
+        vector<pair<NodeId, bool>> pending{{root, false}};
+        while (!pending.empty())
+        {
+            auto [node, operandsDone] = pending.back();
+            pending.pop_back();
+            if (failStamp[node] == loopStamp)
+            {
+                continue;
+            }
+            const ASTnode &n = ast[node];
+            if (!isOperator(n.kind))
+            {
+                failFree[node] = n.kind == NodeKind::NUMBER ? !n.literalTooLarge : assigned[slotOf(node)];
+            }
+            else if (!operandsDone)
+            {
+                pending.push_back({node, true});
+                pending.push_back({n.right, false});
+                pending.push_back({n.left, false});
+                continue;
+            }
+            else
+            {
+                const ASTnode &divisor = ast[n.right];
+                bool safeDivisor = n.kind != NodeKind::DIVIDE
+                                   || (divisor.kind == NodeKind::NUMBER && !divisor.literalTooLarge && divisor.value != 0);
+                failFree[node] = failFree[n.left] && failFree[n.right] && safeDivisor;
+            }
+            failStamp[node] = loopStamp;
+        }
+        return failFree[root];
+    }
+
+    /*
+    Loop-invariant code motion: computes in front of the while loop at node, into their
+    temporaries, the largest expressions of its condition and of the assignments its body runs on
+    every iteration that read no variable the loop assigns. Only expressions that cannot fail are
+    moved, as the loop may run no iteration, so no error happens earlier or in place of another.
+    */
+    void hoistInvariants(NodeId node)
+    {
+        const ASTnode &w = ast[node];
+        loopStamp++;
+        vector<NodeId> pending{w.left};
+        const ASTnode &body = ast[w.right];
+        if (body.kind == NodeKind::ASSIGN)
+        {
+            pending.push_back(body.right);
+        }
+        else if (body.kind == NodeKind::SEQUENCE)
+        {
+            for (NodeId statement : ast.block(w.right))
+            {
+                if (ast[statement].kind == NodeKind::ASSIGN)
+                {
+                    pending.push_back(ast[statement].right);
+                }
+            }
+        }
+        while (!pending.empty())
+        {
+            NodeId expression = pending.back();
+            pending.pop_back();
+            const ASTnode &n = ast[expression];
+            if (!isOperator(n.kind))
+            {
+                continue;
+            }
+            if ((variables[expression] & variables[node]) == 0 && cannotFail(expression))
+            {
+                if (!isAvailable[expression])
+                {
+                    compileExpression(expression, true);
+                }
+                continue;
+            }
+            pending.push_back(n.right);
+            pending.push_back(n.left);
+        }
+    }
+
+    /*
+    Drops the KEEP instructions whose value is never loaded, which are most of them, then numbers
+    the temporaries that are left from the first slot after the variables.
+    */
+    void dropUnusedTemporaries()
+    {
+        vector<Instruction> &code = program.code;
+        size_t first = slots.names.size();
+        vector<uint8_t> drop(code.size(), 0);
+        for (size_t keep = 0; keep < keptAt.size(); keep++)
+        {
+            drop[keptAt[keep]] = !keepLoaded[keep];
+        }
+        // newIndex[pc]: where instruction pc, or the first one kept after it, ends up
+        vector<int32_t> newIndex(code.size() + 1);
+        size_t kept = 0;
+        for (size_t pc = 0; pc < code.size(); pc++)
+        {
+            newIndex[pc] = (int32_t)kept;
+            if (!drop[pc])
+            {
+                code[kept] = code[pc];
+                if (profile == ProfileMode::SAMPLE)
+                {
+                    program.statementAt[kept] = program.statementAt[pc];
+                }
+                kept++;
+            }
+        }
+        newIndex[code.size()] = (int32_t)kept;
+        code.resize(kept);
+        if (profile == ProfileMode::SAMPLE)
+        {
+            program.statementAt.resize(kept);
+        }
+        for (int32_t &exit : program.loopExits)
+        {
+            exit = newIndex[exit];
+        }
+
+        vector<int32_t> renumbered(temporaryUsed.size(), -1);
+        for (size_t t = 0; t < temporaryUsed.size(); t++)
+        {
+            if (temporaryUsed[t])
+            {
+                renumbered[t] = (int32_t)(first + program.temporaries++);
+            }
+        }
+        for (Instruction &in : code)
+        {
+            if (in.op == Opcode::JUMP || in.op == Opcode::JUMP_IF_NOT_POSITIVE)
+            {
+                in.operand = newIndex[in.operand];
+            }
+            else if ((in.op == Opcode::LOAD || in.op == Opcode::STORE || in.op == Opcode::KEEP) && in.operand >= (int32_t)first)
+            {
+                in.operand = renumbered[in.operand - first];
+            }
+        }
+    }
+
+    // hoisted: the value goes into the temporary of root instead of onto the stack (see hoistInvariants)
+    void compileExpression(NodeId root, bool hoisted = false)
+    {
+        // post-order with an explicit stack: a deeply nested expression must not overflow the call stack
+        vector<pair<NodeId, bool>> pending{{root, false}};
+        while (!pending.empty())
+        {
+            auto [node, operandsDone] = pending.back();
+            pending.pop_back();
+            const ASTnode &n = ast[node];
+            switch (n.kind)
+            {
+            case NodeKind::NUMBER:
+                emit(n.literalTooLarge ? Opcode::LITERAL_TOO_LARGE : Opcode::PUSH, n.value);
+                push(1);
+                break;
+            case NodeKind::IDENTIFIER:
+            {
+                int slot = slotOf(node);
+                emit(assigned[slot] ? Opcode::LOAD : Opcode::LOAD_CHECKED, slot);
+                push(1);
+                break;
+            }
+            case NodeKind::PLUS:
+            case NodeKind::MINUS:
+            case NodeKind::TIMES:
+            case NodeKind::DIVIDE:
+                if (!operandsDone)
+                {
+                    if (reuseValues && isAvailable[node])
+                    {
+                        // computed before with the same variables, so it could not fail here either
+                        const Available &value = *find_if(available.begin(), available.end(),
+                                                          [&](const Available &v) { return v.expression == node; });
+                        emit(Opcode::LOAD, value.slot);
+                        push(1);
+                        temporaryUsed[value.slot - slots.names.size()] = 1;
+                        if (value.keep >= 0)
+                        {
+                            keepLoaded[value.keep] = 1;
+                        }
+                        break;
+                    }
+                    pending.push_back({node, true});
+                    pending.push_back({n.right, false});
+                    pending.push_back({n.left, false});
+                    break;
+                }
+                emit(n.kind == NodeKind::PLUS    ? Opcode::ADD
+                     : n.kind == NodeKind::MINUS ? Opcode::SUBTRACT
+                     : n.kind == NodeKind::TIMES ? Opcode::MULTIPLY
+                                                 : Opcode::DIVIDE,
+                     0);
+                push(-1);
+                if (hoisted && node == root)
+                {
+                    keepValue(node, true);
+                }
+                else if (reuseValues && repeated[node])
+                {
+                    keepValue(node, false);
+                }
+                break;
+            default:
+                throw runtime_error("Invalid node type in expression");
+            }
+        }
+    }
+
+    /*
+    An entry of compileStatement's work stack. STATEMENT compiles a statement; the others finish
+    an if or a while statement once the branch or body pushed above them has been compiled.
+    */
+    struct Step
+    {
+        enum Kind
+        {
+            STATEMENT,
+            ELSE_BRANCH,
+            END_IF,
+            END_WHILE
+        } kind;
+        NodeId node;
+        size_t jump = 0;            // ELSE_BRANCH: to the else branch, END_IF: over it, END_WHILE: out of the loop
+        size_t top = 0;             // END_WHILE: where the condition starts
+        int accelerated = -1;       // END_WHILE: index in program.loops, or -1
+        vector<uint8_t> saved{};    // assigned before the if or the loop, END_IF: after the then branch
+        vector<Available> values{}; // --cse, ELSE_BRANCH and END_IF: available after the condition, END_WHILE: once the loop is left
+    };
+
+    // Nested statements are compiled from an explicit stack, so their depth is not limited by the call stack
+    void compileStatement(NodeId root)
+    {
+        vector<Step> steps;
+        steps.push_back(Step{Step::STATEMENT, root});
+        while (!steps.empty())
+        {
+            Step step = std::move(steps.back());
+            steps.pop_back();
+            const ASTnode &n = ast[step.node];
+            if (step.kind != Step::STATEMENT)
+            {
+                statement = step.node; // the jumps that finish an if or a while are part of it
+            }
+            switch (step.kind)
+            {
+            case Step::STATEMENT:
+                compileOneStatement(step.node, steps);
+                break;
+            case Step::ELSE_BRANCH:
+            {
+                size_t toEnd = emit(Opcode::JUMP, 0);
+                vector<uint8_t> afterThen = std::move(assigned);
+                assigned = std::move(step.saved);
+                restoreAvailable(step.values);
+                patchJump(step.jump);
+                steps.push_back(Step{Step::END_IF, step.node, toEnd, 0, -1, std::move(afterThen), std::move(step.values)});
+                steps.push_back(Step{Step::STATEMENT, n.extra});
+                break;
+            }
+            case Step::END_IF:
+                patchJump(step.jump);
+                markStatementEnd();
+                // what was available before the branches, unless one of them assigned a variable it reads
+                if (reuseValues)
+                {
+                    restoreAvailable(std::move(step.values));
+                    forget(variables[step.node]);
+                }
+                // assigned afterwards only if both branches assign it
+                for (size_t slot = 0; slot < assigned.size(); slot++)
+                {
+                    assigned[slot] = assigned[slot] && step.saved[slot];
+                }
+                break;
+            case Step::END_WHILE:
+                emit(Opcode::JUMP, (int32_t)step.top);
+                patchJump(step.jump);
+                if (step.accelerated >= 0)
+                {
+                    program.loopExits[step.accelerated] = (int32_t)program.code.size();
+                }
+                markStatementEnd();
+                assigned = std::move(step.saved);
+                if (reuseValues)
+                {
+                    restoreAvailable(std::move(step.values));
+                }
+                break;
+            }
+        }
+    }
+
+    // Compiles the statement at node, pushing what is left of it (branches, body, next statements) on steps
+    void compileOneStatement(NodeId node, vector<Step> &steps)
+    {
+        const ASTnode &n = ast[node];
+        if (n.kind != NodeKind::SEQUENCE)
+        {
+            markStatement(node);
+        }
+        switch (n.kind)
+        {
+        case NodeKind::ASSIGN:
+        {
+            compileExpression(n.right);
+            int slot = slotOf(n.left);
+            emit(Opcode::STORE, slot);
+            push(-1);
+            assigned[slot] = 1;
+            if (reuseValues)
+            {
+                forget(variableBit(slot));
+            }
+            markStatementEnd();
+            break;
+        }
+        case NodeKind::SEQUENCE:
+        {
+            // pushed last to first so they are compiled in order
+            StatementBlock statements = ast.block(node);
+            for (size_t i = statements.size(); i-- > 0;)
+            {
+                steps.push_back(Step{Step::STATEMENT, statements[i]});
+            }
+            break;
+        }
+        case NodeKind::IF:
+        {
+            compileExpression(n.left);
+            size_t toElse = emit(Opcode::JUMP_IF_NOT_POSITIVE, 0);
+            push(-1);
+            steps.push_back(Step{Step::ELSE_BRANCH, node, toElse, 0, -1, assigned, available});
+            steps.push_back(Step{Step::STATEMENT, n.right});
+            break;
+        }
+        case NodeKind::WHILE:
+        {
+            AffineLoop loop;
+            int accelerated = -1;
+            if (accelerateLoops && analyzeAffineLoop(ast, slots, node, loop))
+            {
+                accelerated = (int)program.loops.size();
+                program.loops.push_back(std::move(loop));
+                program.loopExits.push_back(0);
+                emit(Opcode::ACCELERATE, accelerated);
+            }
+            /*
+            Only the values whose variables the loop leaves alone hold on every iteration. ACCELERATE
+            leaves the loop without computing anything, so after an accelerated loop only those do.
+            */
+            vector<Available> exitValues;
+            if (reuseValues)
+            {
+                forget(variables[node]);
+                exitValues = available;
+                hoistInvariants(node);
+            }
+            // the back edge skips ACCELERATE: if it could not take the loop on entry it runs normally
+            size_t top = program.code.size();
+            compileExpression(n.left);
+            size_t toEnd = emit(Opcode::JUMP_IF_NOT_POSITIVE, 0);
+            push(-1);
+            if (reuseValues && accelerated < 0)
+            {
+                exitValues = available; // the condition failing is the only way out
+            }
+            if (budgeted)
+            {
+                emit(Opcode::LOOP_BUDGET, (int32_t)node);
+            }
+            // the body may run zero times, so what it assigns does not count afterwards
+            steps.push_back(Step{Step::END_WHILE, node, toEnd, top, accelerated, assigned, std::move(exitValues)});
+            steps.push_back(Step{Step::STATEMENT, n.right});
+            break;
+        }
+        case NodeKind::SKIP:
+            markStatementEnd();
+            break;
+        default:
+            throw runtime_error("Invalid statement type");
+        }
+    }
+};
+
+Bytecode compileProgram(const AST &ast, bool accelerateLoops, ProfileMode profile, bool budgeted, bool reuseValues)
+{
+    Compiler compiler(ast, accelerateLoops, profile, budgeted, reuseValues);
+    return compiler.compile();
+}
+
+// A variable's name, or $N for the temporary N
+static string slotName(const Bytecode &program, int32_t slot)
+{
+    return slot < (int32_t)program.slotNames.size() ? program.slotNames[slot] : "$" + to_string(slot - program.slotNames.size());
+}
+
+void disassemble(const Bytecode &program, ostream &out)
+{
+    static const char *const NAMES[] = {"PUSH", "LOAD", "LOAD_CHECKED", "STORE", "KEEP", "ADD", "SUBTRACT", "MULTIPLY",
+                                        "DIVIDE", "JUMP", "JUMP_IF_NOT_POSITIVE", "LITERAL_TOO_LARGE", "ACCELERATE",
+                                        "PROFILE_ENTER", "PROFILE_EXIT", "LOOP_BUDGET", "HALT"};
+    for (size_t pc = 0; pc < program.code.size(); pc++)
+    {
+        const Instruction &in = program.code[pc];
+        out << pc << ": " << NAMES[(int)in.op];
+        switch (in.op)
+        {
+        case Opcode::PUSH:
+        case Opcode::JUMP:
+        case Opcode::JUMP_IF_NOT_POSITIVE:
+        case Opcode::PROFILE_ENTER:
+        case Opcode::LOOP_BUDGET:
+            out << " " << in.operand;
+            break;
+        case Opcode::LOAD:
+        case Opcode::LOAD_CHECKED:
+        case Opcode::STORE:
+        case Opcode::KEEP:
+            out << " " << slotName(program, in.operand);
+            break;
+        case Opcode::ACCELERATE:
+            out << " " << program.loops[in.operand].description << " -> " << program.loopExits[in.operand];
+            break;
+        default:
+            break;
+        }
+        out << "\n";
+    }
+}
+
+VirtualMachine::VirtualMachine(const Bytecode &bytecode, Profiler *profiler, ExecutionBudget *budget)
+    : program(bytecode),
+      values(bytecode.slotNames.size() + bytecode.temporaries, 0),
+      defined(bytecode.slotNames.size() + bytecode.temporaries, 0),
+      stack(bytecode.maxStackDepth + 1, 0),
+      reported(bytecode.loops.size(), 0),
+      profiler(profiler),
+      budget(budget)
+{
+}
+
+bool VirtualMachine::accelerate(int index)
+{
+    const AffineLoop &loop = program.loops[index];
+    for (int32_t slot : loop.readSlots)
+    {
+        if (!defined[slot])
+        {
+            return false; // running it normally reports the undefined variable
+        }
+    }
+    int64_t trips;
+    if (!runAffineLoop(loop, values.data(), trips))
+    {
+        return false;
+    }
+    if (reportLoops && !reported[index])
+    {
+        reportAcceleratedLoop(loop, trips);
+        reported[index] = 1;
+    }
+    return true;
+}
+
+void VirtualMachine::run()
+{
+    if (budget)
+    {
+        // the VM never allocates while it runs, so this does not change
+        budget->measureMemoryWith([this]()
+                                  { return values.capacity() * sizeof(int) + defined.capacity() +
+                                           stack.capacity() * sizeof(int) + reported.capacity(); });
+        budget->start();
+    }
+    // separate copies of the loop, so the one that normally runs neither updates running nor counts
+    if (profiler && profiler->mode() == ProfileMode::SAMPLE)
+    {
+        profiler->sample(program, *this);
+        execute<true, false>();
+    }
+    else if (countSteps)
+    {
+        execute<false, true>();
+    }
+    else
+    {
+        execute<false, false>();
+    }
+}
+
+template <bool SAMPLED, bool COUNTED>
+void VirtualMachine::execute()
+{
+    const Instruction *code = program.code.data();
+    int *vars = values.data();
+    uint8_t *isDefined = defined.data();
+    int *sp = stack.data(); // one past the top of the stack
+    const Instruction *pc = code;
+
+    if constexpr (SAMPLED)
+    {
+        running = pc;
+    }
+
+    for (;;)
+    {
+        if constexpr (COUNTED)
+        {
+            steps++;
+        }
+        const Instruction &in = *pc++;
+        switch (in.op)
+        {
+        case Opcode::PUSH:
+            *sp++ = in.operand;
+            break;
+        case Opcode::LOAD_CHECKED:
+            if (!isDefined[in.operand])
+            {
+                throw runtime_error("Undefined variable: " + program.slotNames[in.operand]);
+            }
+            *sp++ = vars[in.operand];
+            break;
+        case Opcode::LOAD:
+            *sp++ = vars[in.operand];
+            break;
+        case Opcode::STORE:
+            vars[in.operand] = *--sp;
+            isDefined[in.operand] = 1;
+            if constexpr (SAMPLED)
+            {
+                running = pc;
+            }
+            break;
+        case Opcode::KEEP:
+            vars[in.operand] = sp[-1];
+            break;
+        case Opcode::ADD:
+            sp--;
+            sp[-1] = limpAdd(sp[-1], sp[0]);
+            break;
+        case Opcode::SUBTRACT:
+            sp--;
+            sp[-1] = limpSubtract(sp[-1], sp[0]);
+            break;
+        case Opcode::MULTIPLY:
+            sp--;
+            sp[-1] = limpMultiply(sp[-1], sp[0]);
+            break;
+        case Opcode::DIVIDE:
+            sp--;
+            sp[-1] = limpDivide(sp[-1], sp[0]);
+            break;
+        case Opcode::JUMP:
+            pc = code + in.operand;
+            if constexpr (SAMPLED)
+            {
+                running = pc;
+            }
+            break;
+        case Opcode::JUMP_IF_NOT_POSITIVE:
+            if (*--sp <= 0)
+            {
+                pc = code + in.operand;
+            }
+            if constexpr (SAMPLED)
+            {
+                running = pc;
+            }
+            break;
+        case Opcode::ACCELERATE:
+            if (accelerate(in.operand))
+            {
+                pc = code + program.loopExits[in.operand];
+            }
+            if constexpr (SAMPLED)
+            {
+                running = pc;
+            }
+            break;
+        case Opcode::PROFILE_ENTER:
+            profiler->enter((NodeId)in.operand);
+            break;
+        case Opcode::PROFILE_EXIT:
+            profiler->leave();
+            break;
+        case Opcode::LOOP_BUDGET:
+            budget->iteration((NodeId)in.operand);
+            break;
+        case Opcode::LITERAL_TOO_LARGE:
+            // the same exception stoi used to throw for this literal
+            throw out_of_range("stoi");
+        case Opcode::HALT:
+            return;
+        }
+    }
+}
+
+map<string, int> VirtualMachine::getMemory() const
+{
+    map<string, int> memory;
+    for (size_t slot = 0; slot < program.slotNames.size(); slot++)
+    {
+        if (defined[slot])
+        {
+            memory[program.slotNames[slot]] = values[slot];
+        }
+    }
+    return memory;
+}
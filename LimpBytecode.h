@@ -0,0 +1,137 @@
+#ifndef LIMP_BYTECODE_H
+#define LIMP_BYTECODE_H
+
+#include "LimpParser.h"
+#include "LimpLoops.h"
+#include "LimpBudget.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <cstdint>
+
+using namespace std;
+
+enum class Opcode : uint8_t
+{
+    PUSH,                 // push operand
+    LOAD,                 // push variable in slot operand, known to be assigned already
+    LOAD_CHECKED,         // same, but fails with "Undefined variable" if the slot was never assigned
+    STORE,                // pop into slot operand
+    KEEP,                 // copy the top of the stack into slot operand, a temporary (see Bytecode), without popping it
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    JUMP,                 // continue at instruction operand
+    JUMP_IF_NOT_POSITIVE, // pop, and jump to operand unless the value is > 0
+    LITERAL_TOO_LARGE,    // a literal that does not fit in an int, fails when reached
+    ACCELERATE,           // run all iterations of loops[operand] at once if possible, then jump to its exit
+    PROFILE_ENTER,        // the statement at node operand starts (see ProfileMode)
+    PROFILE_EXIT,         // the statement entered last ends
+    LOOP_BUDGET,          // an iteration of the loop at node operand starts (see ExecutionBudget)
+    HALT
+};
+
+struct Instruction
+{
+    Opcode op;
+    int32_t operand;
+};
+
+/*
+How compileProgram prepares a program for the Profiler (see LimpProfiler.h). OFF adds
+nothing, so a program that is not profiled runs exactly the code it always did.
+EXACT wraps every statement in PROFILE_ENTER and PROFILE_EXIT instructions, which count
+its executions and time it. That costs two clock reads per statement executed.
+SAMPLE adds no instructions, only Bytecode::statementAt. The VirtualMachine then publishes
+where it is at every store and jump, and a timer signal samples that about a thousand times
+a second, for a few percent of overhead.
+*/
+enum class ProfileMode : uint8_t
+{
+    OFF,
+    EXACT,
+    SAMPLE
+};
+
+/*
+A Limp program compiled for the VirtualMachine. Every distinct variable gets a slot
+(its index in slotNames), and the stack never grows beyond maxStackDepth.
+temporaries more slots follow the variables' ones, which keep values computed once for
+later (see compileProgram); they have no name and are no variables of the program.
+loops holds the while loops that have an ACCELERATE instruction in front of them,
+and loopExits the instruction following each of them.
+*/
+struct Bytecode
+{
+    vector<Instruction> code;
+    vector<string> slotNames;
+    int maxStackDepth = 0;
+    int temporaries = 0;
+    vector<AffineLoop> loops;
+    vector<int32_t> loopExits;
+    vector<NodeId> statementAt; // SAMPLE: per instruction, the innermost statement it belongs to
+};
+
+/*
+accelerateLoops = false compiles every loop to plain jumps (see LimpLoops.h).
+profile adds the instructions that report the statements to a Profiler; such a program
+has to run on a VirtualMachine that was given one.
+budgeted adds a LOOP_BUDGET instruction at the start of every loop body; such a program has
+to run on an engine that was given an ExecutionBudget.
+reuseValues keeps the value of an expression computed more than once in a temporary slot and
+loads it from there while none of its variables has been assigned since (common subexpression
+elimination), and computes the expressions of a while loop that read no variable the loop
+assigns once in front of it (loop-invariant code motion). Only an expression that cannot fail
+is moved in front of a loop, and a value is only reused where computing it again would have
+succeeded, so every error happens at the same point as without.
+*/
+Bytecode compileProgram(const AST &ast, bool accelerateLoops = true, ProfileMode profile = ProfileMode::OFF,
+                        bool budgeted = false, bool reuseValues = false);
+
+void disassemble(const Bytecode &program, ostream &out);
+
+class Profiler;
+
+class VirtualMachine
+{
+public:
+    VirtualMachine(const Bytecode &program, Profiler *profiler = nullptr, ExecutionBudget *budget = nullptr);
+
+    // Runs the program to the end; errors are thrown as runtime_error like the Evaluator does
+    void run();
+
+    /*
+    SAMPLE: the instruction after the last STORE or jump, for the Profiler's timer signal.
+    Statements only start there, so the instructions running since belong to the same statement.
+    */
+    const Instruction *volatile running = nullptr;
+
+    // Set before run to count the instructions executed in steps (for --trace)
+    bool countSteps = false;
+    uint64_t steps = 0;
+
+    // Cleared before run to keep the "Accelerated loop" lines off the console (the server does)
+    bool reportLoops = true;
+
+    // The assigned variables by name, the same map Evaluator::getMemory returns
+    map<string, int> getMemory() const;
+
+private:
+    const Bytecode &program;
+    vector<int> values;
+    vector<uint8_t> defined;
+    vector<int> stack;
+    vector<uint8_t> reported; // per loop, whether its acceleration was logged already
+    Profiler *profiler;
+    ExecutionBudget *budget;
+
+    bool accelerate(int loop);
+
+    // The dispatch loop; SAMPLED also keeps running up to date, COUNTED adds up steps
+    template <bool SAMPLED, bool COUNTED>
+    void execute();
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Program cache for Limp
+Description: This module saves what the scanner and the parser produced for a program (its
+             token list and its AST) in a compact binary file, and loads it back on the next
+             run of the same source, so the interpreter can skip scanning and parsing.
+*/
+
+#include "LimpCache.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// Bumped whenever the layout below or the meaning of a field changes
+const uint32_t CACHE_VERSION = 3;
+const char CACHE_MAGIC[12] = "LIMPCACHE";
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct CacheHeader
+{
+    char magic[12];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint32_t tokenCount;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint32_t nodeCount;
+    uint32_t nameCount;
+    uint64_t nameBytes;
+    uint32_t root;
+    uint32_t byteOrder; // BYTE_ORDER_MARK as written, so a file from a big-endian machine is rejected
+    uint32_t blockCount;
+    uint32_t unused;
+};
+static_assert(sizeof(CacheHeader) == 72, "the header has no padding");
+
+struct TokenRecord
+{
+    uint32_t offset;
+    uint32_t length;
+    uint8_t kind;
+    uint8_t unused[3];
+};
+static_assert(sizeof(TokenRecord) == 12, "token records have no padding");
+
+uint64_t hashSource(string_view source)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : source)
+    {
+        hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool writeProgramCache(const string &path, string_view source, const vector<CachedToken> &tokens, const AST &ast)
+{
+    if (source.size() > UINT32_MAX)
+    {
+        return false; // token offsets are 32 bits
+    }
+    CacheHeader header = {};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.nodeSize = sizeof(ASTnode);
+    header.tokenCount = (uint32_t)tokens.size();
+    header.sourceHash = hashSource(source);
+    header.sourceLength = source.size();
+    header.nodeCount = (uint32_t)ast.nodes.size();
+    header.nameCount = (uint32_t)ast.names.size();
+    for (const string &name : ast.names)
+    {
+        header.nameBytes += name.size();
+    }
+    header.root = ast.root;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.blockCount = (uint32_t)ast.blocks.size();
+
+    string bytes((const char *)&header, sizeof(header));
+    bytes.reserve(sizeof(header) + tokens.size() * sizeof(TokenRecord) + ast.nodes.size() * sizeof(ASTnode) +
+                  ast.blocks.size() * sizeof(NodeId) + ast.names.size() * 4 + header.nameBytes);
+    for (const CachedToken &token : tokens)
+    {
+        TokenRecord record = {token.offset, token.length, (uint8_t)token.kind, {0, 0, 0}};
+        bytes.append((const char *)&record, sizeof(record));
+    }
+    bytes.append((const char *)ast.nodes.data(), ast.nodes.size() * sizeof(ASTnode));
+    bytes.append((const char *)ast.blocks.data(), ast.blocks.size() * sizeof(NodeId));
+    for (const string &name : ast.names)
+    {
+        uint32_t length = (uint32_t)name.size();
+        bytes.append((const char *)&length, sizeof(length));
+    }
+    for (const string &name : ast.names)
+    {
+        bytes += name;
+    }
+
+    // written aside and renamed, so a run reading the cache at the same time never sees half of it
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        if (!file.is_open() || !file.write(bytes.data(), (streamsize)bytes.size()))
+        {
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readProgramCache(const string &path, string_view source, vector<CachedToken> &tokens, AST &ast)
+{
+    FileBytes file(path);
+    if (!file.data || file.size < sizeof(CacheHeader))
+    {
+        return false;
+    }
+    CacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION ||
+        header.nodeSize != sizeof(ASTnode) || header.byteOrder != BYTE_ORDER_MARK ||
+        header.sourceLength != source.size() || header.sourceHash != hashSource(source))
+    {
+        return false;
+    }
+    uint64_t expected = sizeof(CacheHeader) + (uint64_t)header.tokenCount * sizeof(TokenRecord) +
+                        (uint64_t)header.nodeCount * sizeof(ASTnode) + (uint64_t)header.blockCount * sizeof(NodeId) +
+                        (uint64_t)header.nameCount * 4 + header.nameBytes;
+    if (header.nameBytes > file.size || expected != file.size)
+    {
+        return false;
+    }
+
+    const char *at = file.data + sizeof(CacheHeader);
+    vector<CachedToken> loadedTokens(header.tokenCount);
+    for (CachedToken &token : loadedTokens)
+    {
+        TokenRecord record;
+        memcpy(&record, at, sizeof(record));
+        at += sizeof(record);
+        if (record.kind > (uint8_t)TokenKind::END_OF_FILE || record.offset > source.size() ||
+            record.length > source.size() - record.offset)
+        {
+            return false;
+        }
+        token = CachedToken{record.offset, record.length, (TokenKind)record.kind};
+    }
+
+    AST loaded;
+    // the node array starts at a multiple of 4 bytes into the file, which is all ASTnode needs
+    const ASTnode *nodes = (const ASTnode *)at;
+    loaded.nodes.assign(nodes, nodes + header.nodeCount);
+    at += (size_t)header.nodeCount * sizeof(ASTnode);
+    const NodeId *blocks = (const NodeId *)at;
+    loaded.blocks.assign(blocks, blocks + header.blockCount);
+    at += (size_t)header.blockCount * sizeof(NodeId);
+
+    const char *lengths = at;
+    const char *characters = at + (size_t)header.nameCount * 4;
+    uint64_t used = 0;
+    loaded.names.reserve(header.nameCount);
+    for (uint32_t symbol = 0; symbol < header.nameCount; symbol++)
+    {
+        uint32_t length;
+        memcpy(&length, lengths + (size_t)symbol * 4, sizeof(length));
+        if (length > header.nameBytes - used)
+        {
+            return false;
+        }
+        // interning again rebuilds the hash table; the names were distinct, so each gets its old symbol
+        if (loaded.intern(string_view(characters + used, length)) != symbol)
+        {
+            return false;
+        }
+        used += length;
+    }
+    if (used != header.nameBytes)
+    {
+        return false;
+    }
+
+    // the evaluators trust the tree, so a damaged file must not get past here
+    for (NodeId id = 0; id < header.nodeCount; id++)
+    {
+        const ASTnode &n = loaded.nodes[id];
+        auto child = [&](NodeId c) { return c == NO_NODE || c < id; };
+        auto statementsBefore = [&]() {
+            if (n.value < 2 || n.symbol > header.blockCount || (uint32_t)n.value > header.blockCount - n.symbol)
+            {
+                return false;
+            }
+            StatementBlock statements = loaded.block(id);
+            return all_of(statements.begin(), statements.end(), [&](NodeId c) { return c < id; });
+        };
+        bool leaf = n.kind == NodeKind::NUMBER || n.kind == NodeKind::IDENTIFIER || n.kind == NodeKind::SKIP;
+        bool block = n.kind == NodeKind::SEQUENCE;
+        if (n.kind > NodeKind::SKIP || !child(n.left) || !child(n.right) || !child(n.extra) ||
+            (!leaf && !block && (n.left == NO_NODE || n.right == NO_NODE)) ||
+            (block && !statementsBefore()) ||
+            (n.kind == NodeKind::IF && n.extra == NO_NODE) ||
+            (n.kind == NodeKind::ASSIGN && loaded.nodes[n.left].kind != NodeKind::IDENTIFIER) ||
+            (leaf && n.kind != NodeKind::SKIP && n.symbol >= header.nameCount))
+        {
+            return false;
+        }
+    }
+    if (header.root != NO_NODE && header.root >= header.nodeCount)
+    {
+        return false;
+    }
+    loaded.root = header.root;
+
+    tokens = std::move(loadedTokens);
+    ast = std::move(loaded);
+    return true;
+}
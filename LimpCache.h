@@ -0,0 +1,49 @@
+#ifndef LIMP_CACHE_H
+#define LIMP_CACHE_H
+
+#include "LimpParser.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+/*
+A token of the token list, kept in the cache by where its text is in the program source
+(the bytes of the input file, which the interpreter scans as they are).
+*/
+struct CachedToken
+{
+    uint32_t offset;
+    uint32_t length;
+    TokenKind kind;
+};
+
+// 64-bit FNV-1a of the program source, which the cache is keyed on
+uint64_t hashSource(string_view source);
+
+/*
+The file a program is cached in between runs (--cache): everything scanning and parsing
+produce, so a run whose source has not changed can skip both. Layout, little-endian:
+
+    header   magic "LIMPCACHE", format version, sizeof(ASTnode), source hash and length,
+             counts of tokens, nodes and names, total bytes of the names, root node, count of block entries
+    tokens   offset, length and kind of each token of the token list (12 bytes each)
+    nodes    the AST's node array as it is in memory (children before parents)
+    blocks   the statements of the SEQUENCE nodes (AST::blocks)
+    names    the length of each interned name, then all their characters
+
+The file is written next to the source and read back whole (through a memory mapping when
+it is large). It is rewritten whenever the source, the format or the node layout changes.
+*/
+bool writeProgramCache(const string &path, string_view source, const vector<CachedToken> &tokens, const AST &ast);
+
+/*
+Fills tokens and ast from the cache at path and returns true when it was written for this
+source by this version. Returns false, leaving both alone, when the file is missing, stale
+or damaged; the caller then scans and parses as usual.
+*/
+bool readProgramCache(const string &path, string_view source, vector<CachedToken> &tokens, AST &ast);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+Name: [Your Name]
+Phase: Interpreter for Limp
+Description: This module implements the tree Evaluator of the Limp language.
+             The evaluator works with the Abstract Syntax Tree (AST) produced by the parser
+             and runs the statements in place on it, keeping the statements under way on a stack.
+             It maintains a memory store in which every variable has a slot assigned before the program runs.
+             The evaluator handles assignments, control flow statements (if-then-else, while loops),
+             and arithmetic expressions (supporting addition, subtraction, multiplication, and division).
+             For subtraction operations, the language ensures non-negative results by returning 0 when
+             the right operand is larger than the left (as negative numbers aren't supported).
+*/
+
+#include "LimpEvaluator.h"
+#include "LimpArithmetic.h"
+#include <vector>
+#include <string>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+Evaluator::Evaluator(const AST& tree, bool accelerateLoops, ExecutionBudget* budget)
+    : ast(tree),
+      slots(resolveVariables(tree)),
+      memory(slots.names.size(), 0),
+      definedBits((slots.names.size() + 63) / 64, 0),
+      loopOf(tree.nodes.size(), -1),
+      constantState(tree.nodes.size(), Constant::VARIES),
+      constantValue(tree.nodes.size(), 0),
+      budget(budget) {
+    // children come before their parents, so one pass in index order sees the operands first
+    for (NodeId node = 0; node < ast.nodes.size(); node++) {
+        const ASTnode& n = ast[node];
+        if (n.kind == NodeKind::NUMBER && !n.literalTooLarge) {
+            constantState[node] = Constant::KNOWN;
+            constantValue[node] = n.value;
+        }
+        else if (n.kind >= NodeKind::PLUS && n.kind <= NodeKind::DIVIDE
+                 && constantState[n.left] != Constant::VARIES && constantState[n.right] != Constant::VARIES) {
+            constantState[node] = Constant::CONSTANT;
+        }
+    }
+    for (NodeId node = 0; accelerateLoops && node < ast.nodes.size(); node++) {
+        AffineLoop loop;
+        if (ast[node].kind == NodeKind::WHILE && analyzeAffineLoop(ast, slots, node, loop)) {
+            loopOf[node] = (int32_t)loops.size();
+            loops.push_back(std::move(loop));
+        }
+    }
+    reported.assign(loops.size(), 0);
+}
+
+int Evaluator::leafValue(NodeId node) {
+    const ASTnode& n = ast[node];
+    if (n.kind == NodeKind::NUMBER) {
+        if (n.literalTooLarge) {
+            // the same exception stoi used to throw for this literal
+            throw out_of_range("stoi");
+        }
+        return n.value;
+    }
+    int32_t slot = slots.slotOf(ast, node);
+    if (!isDefined(slot)) {
+        throw runtime_error("Undefined variable: " + ast.name(node));
+    }
+    return memory[slot];
+}
+
+int Evaluator::evaluateExpression(NodeId root) {
+    NodeKind rootKind = ast[root].kind;
+    if (rootKind == NodeKind::NUMBER || rootKind == NodeKind::IDENTIFIER) {
+        return leafValue(root); // a good part of all operands, which need no walk
+    }
+    values.clear();
+    pending.clear();
+    pending.push_back({root, false});
+    while (!pending.empty()) {
+        auto [node, operandsDone] = pending.back();
+        pending.pop_back();
+        const ASTnode& n = ast[node];
+        if (n.kind == NodeKind::NUMBER || n.kind == NodeKind::IDENTIFIER) {
+            values.push_back(leafValue(node));
+        }
+        else if (constantState[node] == Constant::KNOWN) {
+            values.push_back(constantValue[node]);
+        }
+        else if (!operandsDone) {
+            pending.push_back({node, true});
+            pending.push_back({n.right, false});
+            pending.push_back({n.left, false});
+        }
+        else {
+            int right = values.back();
+            values.pop_back();
+            int& left = values.back();
+
+            if (n.kind == NodeKind::PLUS) {
+                left = limpAdd(left, right);
+            }
+            else if (n.kind == NodeKind::MINUS) {
+                left = limpSubtract(left, right);
+            }
+            else if (n.kind == NodeKind::TIMES) {
+                left = limpMultiply(left, right);
+            }
+            else if (n.kind == NodeKind::DIVIDE) {
+                left = limpDivide(left, right);
+            }
+            else {
+                throw runtime_error("Invalid node type in expression");
+            }
+            // only a value is remembered: a division by zero has thrown above
+            if (constantState[node] == Constant::CONSTANT) {
+                constantState[node] = Constant::KNOWN;
+                constantValue[node] = left;
+            }
+        }
+    }
+    return values.back();
+}
+
+// Runs every remaining iteration of the loop at once when LimpLoops can do it exactly
+bool Evaluator::accelerate(NodeId node) {
+    int32_t index = loopOf[node];
+    if (index < 0) {
+        return false;
+    }
+    const AffineLoop& loop = loops[index];
+    for (int32_t slot : loop.readSlots) {
+        if (!isDefined(slot)) {
+            return false;
+        }
+    }
+    int64_t trips;
+    if (!runAffineLoop(loop, memory.data(), trips)) {
+        return false;
+    }
+    if (!reported[index]) {
+        reportAcceleratedLoop(loop, trips);
+        reported[index] = 1;
+    }
+    return true;
+}
+
+bool Evaluator::loopContinues(NodeId node) {
+    if (accelerate(node) || evaluateExpression(ast[node].left) <= 0) {
+        return false;
+    }
+    if (budget) {
+        budget->iteration(node);
+    }
+    return true;
+}
+
+size_t Evaluator::workingMemory() const {
+    return memory.capacity() * sizeof(int) + definedBits.capacity() * sizeof(uint64_t)
+         + running.capacity() * sizeof(Running) + pending.capacity() * sizeof(pair<NodeId, bool>)
+         + values.capacity() * sizeof(int)
+         + loopOf.capacity() * sizeof(int32_t) + reported.capacity()
+         + constantState.capacity() + constantValue.capacity() * sizeof(int);
+}
+
+void Evaluator::evaluate() {
+    if (budget) {
+        budget->measureMemoryWith([this]() { return workingMemory(); });
+        budget->start();
+    }
+    NodeId node = ast.root;
+    while (true) {
+        // Runs node, until it is done or one of its statements has to run first
+        while (node != NO_NODE) {
+            steps++;
+            const ASTnode& n = ast[node];
+            if (n.kind == NodeKind::ASSIGN) {
+                int value = evaluateExpression(n.right);
+                int32_t slot = slots.slotOf(ast, n.left);
+                memory[slot] = value;
+                definedBits[slot / 64] |= uint64_t(1) << (slot % 64);
+                node = NO_NODE;
+            }
+            else if (n.kind == NodeKind::SEQUENCE) {
+                // the first statement now, each of the others once the one before it is done
+                running.push_back({node, n.symbol + 1});
+                node = ast.blocks[n.symbol];
+            }
+            else if (n.kind == NodeKind::IF) {
+                // left = condition, right = then branch, extra = else branch, which runs in place of the if
+                node = evaluateExpression(n.left) > 0 ? n.right : n.extra;
+            }
+            else if (n.kind == NodeKind::WHILE) {
+                // left = condition, right = body
+                if (loopContinues(node)) {
+                    running.push_back({node, 0});
+                    node = n.right;
+                }
+                else {
+                    node = NO_NODE;
+                }
+            }
+            else if (n.kind == NodeKind::SKIP) {
+                node = NO_NODE;
+            }
+            else {
+                throw runtime_error("Invalid statement type");
+            }
+        }
+
+        // A statement is done, the innermost statement under way goes on
+        if (running.empty()) {
+            return;
+        }
+        Running& outer = running.back();
+        const ASTnode& o = ast[outer.node];
+        if (o.kind == NodeKind::SEQUENCE) {
+            node = ast.blocks[outer.next++];
+            if (outer.next == o.symbol + (uint32_t)o.value) {
+                running.pop_back(); // the last statement runs in place of the block
+            }
+        }
+        else {
+            // the loop body is done, the loop runs on until its condition fails
+            steps++;
+            if (loopContinues(outer.node)) {
+                node = o.right;
+            }
+            else {
+                running.pop_back();
+            }
+        }
+    }
+}
+
+map<string, int> Evaluator::getMemory() const {
+    map<string, int> named;
+    for (size_t slot = 0; slot < memory.size(); slot++) {
+        if (isDefined((int32_t)slot)) {
+            named[slots.names[slot]] = memory[slot];
+        }
+    }
+    return named;
+}
@@ -0,0 +1,104 @@
+#ifndef LIMP_EVALUATOR_H
+#define LIMP_EVALUATOR_H
+
+#include "LimpParser.h"
+#include "LimpLoops.h"
+#include "LimpBudget.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+using namespace std;
+
+/*
+Runs a program directly on its AST. It is the reference the VirtualMachine and the native
+code are compared with (--engine=tree), and gives the same results and the same errors.
+Statements run in place on the tree, which is never copied or modified, and once its stacks
+have grown to the depth of the program the evaluator no longer allocates memory.
+A constant subexpression is computed once per run, however often it is reached.
+*/
+class Evaluator {
+    private:
+    const AST& ast;
+    /*
+    Every variable has a slot (see resolveVariables), and the memory is a flat array indexed by slot.
+    definedBits has one bit per slot that is set by the first assignment, so reading a variable
+    that was never assigned is still reported as "Undefined variable".
+    The name to value map is only built by getMemory once the program has finished.
+    */
+    VariableSlots slots;
+    vector<int> memory;
+    vector<uint64_t> definedBits;
+    /*
+    The statements under way, innermost last: a SEQUENCE one of whose statements is running
+    (next is the position in AST::blocks of the statement that runs after it) and a while loop
+    whose body is running (its condition is tested again next, and it stays here until that fails).
+    This is the call stack of a recursive big-step evaluator, kept on the heap so nesting is only
+    limited by memory.
+    */
+    struct Running {
+        NodeId node;
+        uint32_t next;
+    };
+    vector<Running> running;
+    /*
+    loopOf[node] is the index in loops of the WHILE node's affine form (see LimpLoops.h),
+    or -1 for nodes that are not such loops.
+    */
+    vector<int32_t> loopOf;
+    vector<AffineLoop> loops;
+    vector<uint8_t> reported;
+    /*
+    Operator nodes with only literals below them (and none too large for an int) are CONSTANT
+    until their value is first computed, then KNOWN with the value in constantValue. Equal
+    expressions are one node (see AST), so this also covers every repetition of one.
+    */
+    enum class Constant : uint8_t {
+        VARIES,
+        CONSTANT,
+        KNOWN
+    };
+    vector<Constant> constantState;
+    vector<int> constantValue;
+    vector<pair<NodeId, bool>> pending; // evaluateExpression's walk and operand stack,
+    vector<int> values;                 // kept to reuse their memory
+    uint64_t steps = 0;
+    ExecutionBudget* budget; // null when the run has no limits
+
+    // Bytes of the vectors above, for the memory limit
+    size_t workingMemory() const;
+
+    bool isDefined(int32_t slot) const {
+        return (definedBits[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    // The value of a NUMBER or IDENTIFIER node
+    int leafValue(NodeId node);
+
+    /*
+    Post-order walk with an explicit stack of nodes (an operator is visited again once both of
+    its operands are on the value stack), so deeply nested expressions do not need a deep call stack.
+    */
+    int evaluateExpression(NodeId node);
+
+    // Runs every remaining iteration of the loop at once when LimpLoops can do it exactly
+    bool accelerate(NodeId node);
+
+    // Whether the WHILE node runs its body once more; when it does, that is an iteration of the budget
+    bool loopContinues(NodeId node);
+
+    public:
+        // budget, when given, is consumed on every loop iteration (see LimpBudget.h)
+        Evaluator(const AST& tree, bool accelerateLoops = true, ExecutionBudget* budget = nullptr);
+
+        void evaluate();
+
+        map<string, int> getMemory() const;
+
+        // The statements evaluate started and the loop conditions it tested again (for --trace)
+        uint64_t stepCount() const { return steps; }
+};
+
+#endif
@@ -1,18 +1,25 @@
 /*
 Name: [Your Name]
 Phase: Interpreter for Limp
-Description: This program implements an evaluator module for the Limp language.
-             The evaluator works with the Abstract Syntax Tree (AST) produced by the parser
-             and executes program statements in a recursive manner.
-             It maintains a memory store implemented as a map that associates variable names with their integer values.
-             The evaluator handles assignments, control flow statements (if-then-else, while loops),
-             and arithmetic expressions (supporting addition, subtraction, multiplication, and division).
-             For subtraction operations, the language ensures non-negative results by returning 0 when
-             the right operand is larger than the left (as negative numbers aren't supported).
+Description: This program implements the interpreter for the Limp language.
+             The program is scanned and parsed into an Abstract Syntax Tree (AST), which runs
+             on the bytecode VirtualMachine, on native code or on the tree Evaluator
+             (see LimpEvaluator.cpp).
              The final state of the program variables is output after evaluation completes.
 */
 
 #include "LimpParser.h"
+#include "LimpBytecode.h"
+#include "LimpOptimizer.h"
+#include "LimpLoops.h"
+#include "LimpJit.h"
+#include "LimpEvaluator.h"
+#include "LimpProfiler.h"
+#include "LimpBudget.h"
+#include "LimpCache.h"
+#include "LimpServer.h"
+#include "Trace.h"
+#include "RecordWriter.h"
 #include <iostream>
 #include <regex>
 #include <vector>
@@ -24,240 +31,443 @@ Description: This program implements an evaluator module for the Limp language.
 #include <utility>
 #include <stack>
 #include <map>
+#include <functional>
 #include <stdexcept>
+#include <cstring>
 
 using namespace std;
 
-class Evaluator {
-    private:
-    shared_ptr<ASTnode> ast;
-    // The memory is implemented as a map that associates variable names (strings) with their integer values
-    map<string, int> memory;
+// The exit status when a limit stopped the program, to tell it apart from an error (1)
+const int EXIT_LIMIT_REACHED = 3;
 
-    int evaluateExpression(shared_ptr<ASTnode> node) {
-        stack<int> s;
-        evaluateExpressionHelper(node, s);
-
-        if (s.empty()) {
-            throw runtime_error("Expression evaluation resulted in empty stack");
+int main(int argc, char *argv[]) {
+    /*
+    Programs run on the bytecode VirtualMachine by default.
+    --engine=tree runs them on the Evaluator instead, which is handy to diff the two.
+    --engine=jit (or --jit) translates the bytecode to native x86-64 code and runs that (see LimpJit.h).
+    --dump-bytecode prints the compiled program to the console.
+    --fold simplifies the AST (see LimpOptimizer.h) after it is printed, before it runs.
+    --no-accel runs counting loops one iteration at a time instead of in closed form (see LimpLoops.h).
+    --cse compiles an expression computed again with the same values to a load of the value kept
+    from before, and moves the expressions a loop does not change in front of it (see compileProgram).
+    --profile (or --profile=exact) counts and times every statement on the virtual machine, prints
+    the hot spots to the console and writes folded stacks to --profile-stacks=FILE (by default the
+    output file name followed by .folded); --profile=sample samples the running statement instead.
+    --trace=FILE writes how long each phase took, with the tokens, nodes, bytes and steps it
+    handled, to FILE in the Chrome trace event format (see Trace.h).
+    --fuel=N, --time-limit=SECONDS and --memory-limit=MB stop a program that runs too many loop
+    iterations, too long or with too much memory (see LimpBudget.h). The values the variables
+    reached are written as the partial output, and the exit status is EXIT_LIMIT_REACHED.
+    --cache keeps the token list and the AST of the program in the file named like the input file
+    followed by .limpc (or FILE with --cache=FILE), and takes them from there instead of scanning
+    and parsing again as long as the source is unchanged (see LimpCache.h).
+    --serve=SOCKET answers requests on a Unix-domain socket instead of running one file (see
+    LimpServer.h), on --threads=N workers, keeping up to --cached-programs=N programs prepared.
+    --format=jsonl or --format=binary writes the output file as records instead of text (see RecordWriter.h).
+    */
+    string engine = "vm";
+    bool dumpBytecode = false;
+    bool foldAST = false;
+    bool accelerateLoops = true;
+    bool reuseValues = false;
+    ProfileMode profile = ProfileMode::OFF;
+    string stacksPath;
+    string tracePath;
+    ExecutionLimits limits;
+    bool useCache = false;
+    string cachePath;
+    ServerOptions server;
+    OutputFormat format = OutputFormat::TEXT;
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--engine=tree" || arg == "--engine=vm" || arg == "--engine=jit") {
+            engine = arg.substr(strlen("--engine="));
         }
-        
-        return s.top();
-    }
-
-    void evaluateExpressionHelper(shared_ptr<ASTnode> node, stack<int>& s) {
-        if (!node) {
-            return;
+        else if (arg == "--jit") {
+            engine = "jit";
         }
-
-        if (node->type == "NUMBER") {
-            s.push(stoi(node->value));
-        }
-        else if (node->type == "IDENTIFIER") {
-            if (memory.find(node->value) == memory.end()) {
-                // If the element isn't found, it returns memory.end()
-                // It will return true if the variable doesn't exist in memory
-                // (the search reached the end without finding it)
-                throw runtime_error("Undefined variable: " + node->value);
-            }
-            s.push(memory[node->value]);
+        else if (arg == "--dump-bytecode") {
+            dumpBytecode = true;
         }
-        else if (node->type == "SYMBOL") {
-            evaluateExpressionHelper(node->left, s);
-            evaluateExpressionHelper(node->right, s);
-
-            int right;
-            int left;
-            right = s.top(); 
-            s.pop();
-            left = s.top();
-            s.pop();
-
-            if (node->value == "+") {
-                s.push(left + right);
-            }
-            else if (node->value == "-") {
-                s.push(left > right ? left - right : 0);
-            }
-            else if (node->value == "*") {
-                s.push(left * right);
-            }
-            else if (node->value == "/") {
-                if (right == 0) {
-                    throw runtime_error("Division by zero");
-                }
-                s.push(left / right);
-            }
-            else {
-                throw runtime_error("Unknown operator: " + node->value);
-            }
+        else if (arg == "--fold") {
+            foldAST = true;
         }
-        else {
-            throw runtime_error("Invalid node type in expression: " + node->type);
+        else if (arg == "--no-accel") {
+            accelerateLoops = false;
         }
-    }
-
-    shared_ptr<ASTnode> evaluateStatement(shared_ptr<ASTnode> node) {
-        if (!node) {
-            return nullptr;
+        else if (arg == "--cse") {
+            reuseValues = true;
         }
-
-        if (node->type == "SYMBOL" && node->value == ":=") {
-            string identifier = node->left->value;
-            int value = evaluateExpression(node->right);
-
-            // The [] operation on a map does 2 things:
-            // If identifier already exists as a key in the map, it returns a reference to its corresponding value
-            // If identifier doesn't exist yet, it creates a new key-value pair with a default-initialized value (0 for integers)
-            // The = operator then assigns the new value to the map entry for that key
-            memory[identifier] = value;
-            return nullptr;
-        }
-        else if (node->type == "IF-STATEMENT") {
-            /*
-            The structure of IF-STATEMENT:
-            ifNode->left = condition
-            ifNode-> right = dummyNode
-            dummyNode->left = thenBranch
-            dummyNode->right = elseBranch
-            */
-            int condition = evaluateExpression(node->left);
-            if (condition > 0) {
-                return node->right->left->clone(); // True condition, replace with then branch
-            } else {
-                return node->right->right->clone(); // False condition, replace with else branch
-            }
+        else if (arg == "--profile" || arg == "--profile=exact") {
+            profile = ProfileMode::EXACT;
         }
-        else if (node->type == "WHILE-LOOP") {
-            /*
-            The structure of WHILE-STATEMENT:
-            left = condition
-            right = body
-            */
-            int condition = evaluateExpression(node->left);
-            if (condition > 0) {
-                return make_shared<ASTnode>(";", "SYMBOL", node->right->clone(), node->clone());
-                /*
-                First executes the body of the loop (the node->right->clone() part)
-                Then comes back to evaluate the entire while loop again (the node->clone() part)
-                This continues until the condition becomes false
-                */
-            } else {
-                return nullptr;
-            }
+        else if (arg == "--profile=sample") {
+            profile = ProfileMode::SAMPLE;
+        }
+        else if (arg.rfind("--profile-stacks=", 0) == 0) {
+            stacksPath = arg.substr(strlen("--profile-stacks="));
+        }
+        else if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(strlen("--trace="));
         }
-        else if (node->type == "KEYWORD" && node->value == "skip") {
-            // Skip statement does nothing
-            return nullptr;
-        }
-        else if (node->type == "SYMBOL" && node->value == ";") {
-            auto newLeft = evaluateStatement(node->left);
-            if (newLeft) {
-                // Left branch transformed to a new subtree
-                return make_shared<ASTnode>(";", "SYMBOL", newLeft, node->right->clone());
-            } else {
-                // Left branch was completely evaluated (removed)
-                return node->right->clone();
+        else if (arg == "--cache") {
+            useCache = true;
+        }
+        else if (arg.rfind("--cache=", 0) == 0) {
+            useCache = true;
+            cachePath = arg.substr(strlen("--cache="));
+        }
+        else if (arg.rfind("--serve=", 0) == 0) {
+            server.socketPath = arg.substr(strlen("--serve="));
+        }
+        else if (arg.rfind("--threads=", 0) == 0) {
+            server.workers = (unsigned)atoi(arg.c_str() + strlen("--threads="));
+        }
+        else if (arg.rfind("--cached-programs=", 0) == 0) {
+            server.cacheEntries = strtoull(arg.c_str() + strlen("--cached-programs="), nullptr, 10);
+        }
+        else if (arg.rfind("--format=", 0) == 0) {
+            if (!parseOutputFormat(arg.substr(strlen("--format=")), format)) {
+                cerr << "Unknown format: " << arg.substr(strlen("--format=")) << " (text, jsonl or binary)" << endl;
+                return 1;
             }
         }
+        else if (arg.rfind("--fuel=", 0) == 0) {
+            limits.fuel = strtoull(arg.c_str() + strlen("--fuel="), nullptr, 10);
+        }
+        else if (arg.rfind("--time-limit=", 0) == 0) {
+            limits.seconds = atof(arg.c_str() + strlen("--time-limit="));
+        }
+        else if (arg.rfind("--memory-limit=", 0) == 0) {
+            limits.memoryBytes = (size_t)(atof(arg.c_str() + strlen("--memory-limit=")) * 1024 * 1024);
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        }
         else {
-            throw runtime_error("Invalid statement type: " + node->type + " " + node->value);
+            paths.push_back(arg);
         }
     }
 
-    public:
-        Evaluator(shared_ptr<ASTnode> tree) : ast(tree) {}
+    if (engine == "jit" && !jitSupported()) {
+        cerr << "--jit is only available on x86-64 Linux" << endl;
+        return 1;
+    }
 
-        void evaluate() {
-            while (ast) {
-                auto newAst = evaluateStatement(ast);
-                ast = newAst;
-            }
-        }
+    if (profile == ProfileMode::SAMPLE && !samplingSupported()) {
+        cerr << "--profile=sample needs a Unix system" << endl;
+        return 1;
+    }
+
+    if (profile != ProfileMode::OFF && engine != "vm") {
+        cerr << "--profile runs the program on the virtual machine" << endl;
+        engine = "vm";
+    }
 
-        map<string, int> getMemory() const {
-            return memory;
+    if (!server.socketPath.empty()) {
+        if (engine != "vm" || profile != ProfileMode::OFF) {
+            cerr << "--serve runs the programs on the virtual machine, without profiling" << endl;
         }
-};
+        if (format != OutputFormat::TEXT) {
+            cerr << "--serve answers in the text format" << endl;
+        }
+        return serveLimp(server, limits, accelerateLoops, foldAST, reuseValues);
+    }
 
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        cout << "Usage: ./LimpInterpreter <input_file> <output_file>" << endl;
+    if (paths.size() < 2) {
+        cout << "Usage: ./LimpInterpreter [--engine=vm|tree|jit] [--jit] [--dump-bytecode] [--fold] [--no-accel] [--cse] [--profile[=exact|sample]] [--profile-stacks=FILE] [--trace=FILE] [--fuel=N] [--time-limit=SECONDS] [--memory-limit=MB] [--cache[=FILE]] [--format=text|jsonl|binary] <input_file> <output_file>" << endl;
+        cout << "       ./LimpInterpreter --serve=SOCKET [--threads=N] [--cached-programs=N] [--fold] [--no-accel] [--cse] [--fuel=N] [--time-limit=SECONDS] [--memory-limit=MB]" << endl;
         return 1;
     }
 
-    string inputFilePath = argv[1];
-    string outputFilePath = argv[2];
-    string line;
-    string fullInput;
+    string inputFilePath = paths[0];
+    string outputFilePath = paths[1];
+    if (useCache && cachePath.empty()) {
+        cachePath = inputFilePath + ".limpc";
+    }
+
+    unique_ptr<Trace> trace;
+    if (!tracePath.empty()) {
+        trace = make_unique<Trace>("LimpInterpreter");
+    }
 
-    ifstream inputFile(inputFilePath);
-    ofstream outputFile(outputFilePath);
+    // the program is scanned as it is in the file, which stays in memory (mapped when it is large) while it is parsed
+    TraceSpan readSpan(trace.get(), "read input");
+    FileBytes input(inputFilePath);
+    ofstream outputFile(outputFilePath, format == OutputFormat::TEXT ? ios::out : ios::out | ios::binary);
 
-    if (!inputFile.is_open() || !outputFile.is_open())
+    if (!input.data || !outputFile.is_open())
     {
         cerr << "ERROR OPENING FILE" << endl;
         return 1;
     }
+    string_view source(input.data, input.size);
+    readSpan.arg("bytes", (long long)source.size());
+    readSpan.end();
 
-    outputFile << "Tokens: " << endl;
+    // the bytes written to the output file since the last call, for the trace
+    streamoff writtenSoFar = 0;
+    auto written = [&]() {
+        streamoff now = trace ? (streamoff)outputFile.tellp() : 0;
+        streamoff bytes = now - writtenSoFar;
+        writtenSoFar = now;
+        return (long long)bytes;
+    };
+    // also after an error, which is where the trace ends
+    auto writeTrace = [&]() {
+        if (trace && !trace->write(tracePath)) {
+            cerr << "Cannot write the trace to " << tracePath << endl;
+        }
+    };
 
-    while (getline(inputFile, line))
-    {
-        if (isOnlyWhiteSpace(line))
+    AST ast;
+    vector<CachedToken> cachedTokens;
+    bool fromCache = false;
+    if (!cachePath.empty()) {
+        TraceSpan loadSpan(trace.get(), "load cache");
+        fromCache = readProgramCache(cachePath, source, cachedTokens, ast);
+        loadSpan.arg("hit", fromCache);
+    }
+
+    // the same tokens, AST, values and errors as records, when the output is not text
+    RecordWriter records(outputFile, format);
+    bool text = format == OutputFormat::TEXT;
+    if (text) {
+        outputFile << "Tokens: " << endl;
+    }
+    else if (format == OutputFormat::BINARY) {
+        outputFile << binaryHeader("LIMP");
+    }
+    // '\n' rather than endl: a flush per token would be a write to the file per token
+    auto writeToken = [&](TokenKind kind, string_view value) {
+        if (!text)
         {
-            continue;
+            records.token((uint8_t)kind, tokenKindName(kind), value);
         }
-        vector<Token> tokens = scanLine(line);
-
-        for (const Token &token : tokens)
+        else if (kind == TokenKind::ERROR)
         {
-            if (token.type == "ERROR READING")
-            {
-                outputFile << "ERROR READING: \"" + token.value + "\"" << endl;
+            outputFile << "ERROR READING: \"" << value << "\"\n";
+        }
+        else
+        {
+            outputFile << value << ": " << tokenKindName(kind) << '\n';
+        }
+    };
+
+    if (fromCache) {
+        TraceSpan tokenList(trace.get(), "token list");
+        for (const CachedToken &token : cachedTokens) {
+            writeToken(token.kind, source.substr(token.offset, token.length));
+        }
+        tokenList.arg("bytes", written());
+        tokenList.end();
+        traceCount(trace.get(), "bytes written", writtenSoFar);
+    }
+    else {
+        /*
+        One pass over the source: the parser pulls the tokens from the scanner, and each one goes
+        into the token list as it is scanned. The tokens after the point where the parser stopped
+        are scanned once it has, so the token list is complete before a syntax error is reported.
+        */
+        TraceSpan parseSpan(trace.get(), "scan and parse");
+        long long tokenCount = 0;
+        Scanner scanner(source);
+        TokenStream ts(scanner, [&](const Token &token) {
+            tokenCount++;
+            writeToken(token.kind, token.value);
+            if (!cachePath.empty()) {
+                cachedTokens.push_back(CachedToken{(uint32_t)(token.value.data() - source.data()), (uint32_t)token.value.size(), token.kind});
+            }
+        });
+        string syntaxError;
+        try {
+            ast.root = parseStatement(ts, ast);
+            if (ts.peek().kind != TokenKind::END_OF_FILE) {
+                syntaxError = "ERROR IN PARSER: Unexpected token: \"" + string(ts.peek().value) + "\" after expression\n";
+            }
+        } catch (const ParseError &e) {
+            syntaxError = e.what();
+        }
+        ts.finish();
+        parseSpan.arg("tokens", tokenCount);
+        parseSpan.arg("nodes", (long long)ast.nodes.size());
+        parseSpan.arg("bytes", written());
+        parseSpan.end();
+        traceCount(trace.get(), "tokens scanned", tokenCount);
+        traceCount(trace.get(), "bytes written", writtenSoFar);
+
+        if (!syntaxError.empty()) {
+            if (text) {
+                outputFile << syntaxError << endl;
             }
-            else
-            {
-                outputFile << token.value << ": " << token.type << endl;
+            else {
+                records.error(syntaxError);
             }
+            outputFile.close();
+            writeTrace();
+            exit(1);
         }
-        fullInput += line + " ";
     }
+    traceCount(trace.get(), "nodes allocated", (long long)ast.nodes.size());
 
-    vector<Token> tokens = scanLine(fullInput);
-    TokenStream ts(tokens);
-    shared_ptr<ASTnode> root = parseStatement(ts, outputFile);
-    Token nextToken = ts.peek();
-    if (nextToken.type != "End of File")
-    {
-        outputFile << "ERROR IN PARSER: Unexpected token: \"" << nextToken.value << "\" after expression"<< endl;
+    // only programs that parsed are cached, a program with errors goes through the parser every time
+    if (!cachePath.empty() && !fromCache) {
+        TraceSpan writeSpan(trace.get(), "write cache");
+        if (!writeProgramCache(cachePath, source, cachedTokens, ast)) {
+            cerr << "Cannot write the program cache to " << cachePath << endl;
+        }
+    }
+
+    TraceSpan printSpan(trace.get(), "print AST");
+    if (text) {
         outputFile << endl;
-        outputFile.close();
-        exit(1);
+        outputFile << "AST:" << endl;
+        printAST(ast, ast.root, outputFile);
+        outputFile << endl;
+    }
+    else {
+        forEachASTLine(ast, ast.root, [&](const ASTLine &line) {
+            records.astNode((uint32_t)line.depth, (uint8_t)ast[line.node].kind, line.type, line.text);
+        });
+    }
+    long long astBytes = written();
+    printSpan.arg("bytes", astBytes);
+    printSpan.end();
+    traceCount(trace.get(), "bytes written", astBytes);
+
+    if (foldAST) {
+        TraceSpan foldSpan(trace.get(), "fold constants");
+        cerr << "Constant folding removed " << foldConstants(ast) << " nodes" << endl;
+    }
+
+    unique_ptr<Profiler> profiler;
+    if (profile != ProfileMode::OFF) {
+        profiler = make_unique<Profiler>(ast, source, profile);
     }
+    // also after an error: where the time went up to the error can be just as interesting
+    auto reportProfile = [&]() {
+        if (!profiler) {
+            return;
+        }
+        profiler->finish();
+        profiler->writeReport(cout);
+        string path = stacksPath.empty() ? outputFilePath + ".folded" : stacksPath;
+        ofstream stacks(path);
+        profiler->writeFoldedStacks(stacks);
+        cout << "Folded stacks written to " << path << endl;
+    };
 
-    outputFile << endl;
-    outputFile << "AST:" << endl;
-    printAST(root, outputFile);
-    outputFile << endl;
+    // an error ends the spans as it leaves them, without the counts
+    unique_ptr<ExecutionBudget> budget;
+    if (limits.any()) {
+        budget = make_unique<ExecutionBudget>(limits);
+    }
+    // a limit stops the engine like an error, but the values it reached are still written
+    unique_ptr<BudgetExceeded> stopped;
+    auto runWithinLimits = [&](const function<void()>& run) {
+        try {
+            run();
+        } catch (const BudgetExceeded &e) {
+            stopped = make_unique<BudgetExceeded>(e);
+        }
+    };
 
     try {
-        Evaluator evaluator(root);
-        evaluator.evaluate();
+        map<string, int> memory;
+        if (engine == "tree") {
+            TraceSpan setUp(trace.get(), "set up evaluator");
+            Evaluator evaluator(ast, accelerateLoops, budget.get());
+            setUp.end();
+            TraceSpan run(trace.get(), "evaluate");
+            runWithinLimits([&]() { evaluator.evaluate(); });
+            run.arg("steps", (long long)evaluator.stepCount());
+            run.end();
+            traceCount(trace.get(), "evaluation steps", (long long)evaluator.stepCount());
+            memory = evaluator.getMemory();
+        }
+        else {
+            TraceSpan compileSpan(trace.get(), "compile");
+            Bytecode bytecode = compileProgram(ast, accelerateLoops, profile, budget != nullptr, reuseValues);
+            compileSpan.arg("instructions", (long long)bytecode.code.size());
+            compileSpan.end();
+            if (dumpBytecode) {
+                disassemble(bytecode, cout);
+            }
+            if (engine == "jit" && bytecode.maxStackDepth > MAX_NATIVE_STACK_DEPTH) {
+                cerr << "Expressions nested too deeply for --jit, running on the virtual machine" << endl;
+                engine = "vm";
+            }
+            if (engine == "jit") {
+                TraceSpan translate(trace.get(), "translate to native code");
+                NativeProgram native(bytecode, budget.get());
+                translate.end();
+                TraceSpan run(trace.get(), "evaluate");
+                runWithinLimits([&]() { native.run(); });
+                run.end();
+                memory = native.getMemory();
+            }
+            else {
+                VirtualMachine vm(bytecode, profiler.get(), budget.get());
+                vm.countSteps = trace != nullptr;
+                if (profiler) {
+                    profiler->start();
+                }
+                TraceSpan run(trace.get(), "evaluate");
+                runWithinLimits([&]() { vm.run(); });
+                run.arg("steps", (long long)vm.steps);
+                run.end();
+                traceCount(trace.get(), "evaluation steps", (long long)vm.steps);
+                memory = vm.getMemory();
+            }
+        }
         
-        // Output the final memory state
-        outputFile << "Output:" << endl;
-        map<string, int> memory = evaluator.getMemory();
+        reportProfile();
+
+        if (stopped) {
+            string where = stoppedWhere(*stopped, ast);
+            cerr << "Execution stopped: " << stopped->what() << where << endl;
+            if (text) {
+                outputFile << "Execution stopped: " << stopped->what() << where << endl;
+            }
+            else {
+                records.stopped("Execution stopped: " + string(stopped->what()) + where);
+            }
+        }
+
+        // Output the final memory state, a line per variable without a flush for each
+        TraceSpan outputSpan(trace.get(), "write output");
+        if (text) {
+            outputFile << (stopped ? "Partial output:" : "Output:") << endl;
+        }
         for (const auto& [var, val] : memory) {
-            outputFile << var << " = " << val << endl;
+            if (text) {
+                outputFile << var << " = " << val << '\n';
+            }
+            else {
+                records.variable(var, val);
+            }
         }
+        long long outputBytes = written();
+        outputSpan.arg("bytes", outputBytes);
+        outputSpan.end();
+        traceCount(trace.get(), "bytes written", outputBytes);
     } catch (const exception &e) {
-        outputFile << "Evaluation Error: " << e.what() << endl;
+        reportProfile();
+        if (text) {
+            outputFile << "Evaluation Error: " << e.what() << endl;
+        }
+        else {
+            records.error("Evaluation Error: " + string(e.what()));
+        }
+        outputFile.close(); // exit does not, and records are not flushed
+        writeTrace();
         exit(1);
     }
 
     
-    inputFile.close();
     outputFile.close();
-    return 0;
+    writeTrace();
+    return stopped ? EXIT_LIMIT_REACHED : 0;
 }
\ No newline at end of file
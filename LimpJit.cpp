@@ -0,0 +1,521 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Native code generation for Limp
+Description: This module turns the bytecode of LimpBytecode.cpp into x86-64 machine code.
+             Each instruction is replaced by a fixed sequence of machine instructions, the
+             variables stay in the same flat array the VirtualMachine uses (addressed through rbx,
+             their defined flags through r12), and the operand stack lives in the native stack
+             frame with its top cached in eax. The stack depth before every instruction is known
+             at compile time, so every stack access is a constant offset from rsp.
+             Errors leave the generated code with a status in eax and are thrown by run,
+             so the code never has to unwind through C++ frames.
+*/
+
+#include "LimpJit.h"
+#include "LimpArithmetic.h"
+#include <iostream>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define LIMP_JIT_SUPPORTED 1
+#else
+#define LIMP_JIT_SUPPORTED 0
+#endif
+
+using namespace std;
+
+bool jitSupported()
+{
+    return LIMP_JIT_SUPPORTED;
+}
+
+// What the generated code returns in eax
+enum NativeStatus : int32_t
+{
+    NATIVE_OK,
+    NATIVE_DIVISION_BY_ZERO,
+    NATIVE_UNDEFINED_VARIABLE, // the slot is left in NativeFrame::errorSlot
+    NATIVE_LITERAL_TOO_LARGE,
+    NATIVE_BUDGET_EXCEEDED // the BudgetExceeded error is left in NativeProgram::stopped
+};
+
+// Passed to the generated code in rdi
+struct NativeFrame
+{
+    int *values;
+    uint8_t *defined;
+    NativeProgram *program;
+    int32_t errorSlot;
+    int32_t budgetTicks; // LOOP_BUDGET: iterations left before budgetFromNative is called again
+};
+
+// Called from the generated code for ACCELERATE, returns 1 when the loop has been run
+int accelerateFromNative(NativeProgram *self, int32_t index)
+{
+    const AffineLoop &loop = self->program.loops[index];
+    for (int32_t slot : loop.readSlots)
+    {
+        if (!self->defined[slot])
+        {
+            return 0;
+        }
+    }
+    int64_t trips;
+    if (!runAffineLoop(loop, self->values.data(), trips))
+    {
+        return 0;
+    }
+    if (!self->reported[index])
+    {
+        reportAcceleratedLoop(loop, trips);
+        self->reported[index] = 1;
+    }
+    return 1;
+}
+
+/*
+Called from the generated code for LOOP_BUDGET once NativeFrame::budgetTicks runs out. Returns the
+iterations granted until the next call (see ExecutionBudget::grant), or -1 when a limit is reached:
+the error cannot be thrown through the generated code, so it is kept for run to throw.
+*/
+int budgetFromNative(NativeProgram *self, int32_t loop)
+{
+    try
+    {
+        return (int)self->budget->grant((NodeId)loop);
+    }
+    catch (const BudgetExceeded &)
+    {
+        self->stopped = current_exception();
+        return -1;
+    }
+}
+
+#if LIMP_JIT_SUPPORTED
+
+/*
+Raw x86-64 encodings. Stack entries are addressed as [rsp + disp32], variables as
+[rbx + disp32] and defined flags as [r12 + disp32].
+*/
+class Assembler
+{
+public:
+    vector<uint8_t> bytes;
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+
+    void bytes3(uint8_t a, uint8_t b, uint8_t c)
+    {
+        byte(a);
+        byte(b);
+        byte(c);
+    }
+
+    void imm32(int32_t value)
+    {
+        uint8_t raw[4];
+        memcpy(raw, &value, 4);
+        bytes.insert(bytes.end(), raw, raw + 4);
+    }
+
+    void imm64(uint64_t value)
+    {
+        uint8_t raw[8];
+        memcpy(raw, &value, 8);
+        bytes.insert(bytes.end(), raw, raw + 8);
+    }
+
+    // Emits a jump with a placeholder displacement and returns where the displacement is
+    size_t jump(uint8_t opcode)
+    {
+        byte(opcode);
+        imm32(0);
+        return bytes.size() - 4;
+    }
+
+    size_t jumpIf(uint8_t condition)
+    {
+        byte(0x0F);
+        return jump(condition);
+    }
+
+    void patch(size_t displacement, size_t target)
+    {
+        int32_t relative = (int32_t)(target - (displacement + 4));
+        memcpy(&bytes[displacement], &relative, 4);
+    }
+
+    void movEaxImm(int32_t value) { byte(0xB8); imm32(value); }
+    void storeEaxToStack(int32_t offset) { bytes3(0x89, 0x84, 0x24); imm32(offset); }
+    void loadEaxFromStack(int32_t offset) { bytes3(0x8B, 0x84, 0x24); imm32(offset); }
+    void loadEcxFromStack(int32_t offset) { bytes3(0x8B, 0x8C, 0x24); imm32(offset); }
+    void loadEaxFromVariable(int32_t slot) { byte(0x8B); byte(0x83); imm32(slot * 4); }
+    void storeEaxToVariable(int32_t slot) { byte(0x89); byte(0x83); imm32(slot * 4); }
+    void cmpDefinedZero(int32_t slot) { bytes3(0x41, 0x80, 0xBC); byte(0x24); imm32(slot); byte(0x00); }
+    void setDefined(int32_t slot) { bytes3(0x41, 0xC6, 0x84); byte(0x24); imm32(slot); byte(0x01); }
+    void addEaxStack(int32_t offset) { bytes3(0x03, 0x84, 0x24); imm32(offset); }
+    void imulEaxStack(int32_t offset) { byte(0x0F); bytes3(0xAF, 0x84, 0x24); imm32(offset); }
+    void testEaxEax() { byte(0x85); byte(0xC0); }
+};
+
+// x86 condition codes for the jcc rel32 forms (0x0F 0x8?)
+const uint8_t JUMP_IF_ZERO = 0x84;
+const uint8_t JUMP_IF_NOT_ZERO = 0x85;
+const uint8_t JUMP_IF_LESS_OR_EQUAL = 0x8E;
+const uint8_t JUMP_IF_SIGN = 0x88;
+const uint8_t JUMP_IF_NOT_SIGN = 0x89;
+
+/*
+The operand stack depth before each instruction. The compiler only jumps at statement
+boundaries, so every instruction has one depth whichever way it is reached.
+*/
+static vector<int> stackDepths(const Bytecode &program)
+{
+    vector<int> depth(program.code.size() + 1, -1);
+    vector<size_t> pending{0};
+    depth[0] = 0;
+    while (!pending.empty())
+    {
+        size_t pc = pending.back();
+        pending.pop_back();
+        int d = depth[pc];
+        const Instruction &in = program.code[pc];
+        vector<size_t> next;
+        int after = d;
+        switch (in.op)
+        {
+        case Opcode::PUSH:
+        case Opcode::LOAD:
+        case Opcode::LOAD_CHECKED:
+            after = d + 1;
+            next.push_back(pc + 1);
+            break;
+        case Opcode::STORE:
+        case Opcode::ADD:
+        case Opcode::SUBTRACT:
+        case Opcode::MULTIPLY:
+        case Opcode::DIVIDE:
+            after = d - 1;
+            next.push_back(pc + 1);
+            break;
+        case Opcode::JUMP:
+            next.push_back(in.operand);
+            break;
+        case Opcode::JUMP_IF_NOT_POSITIVE:
+            after = d - 1;
+            next.push_back(pc + 1);
+            next.push_back(in.operand);
+            break;
+        case Opcode::ACCELERATE:
+            next.push_back(pc + 1);
+            next.push_back(program.loopExits[in.operand]);
+            break;
+        case Opcode::KEEP:
+        case Opcode::PROFILE_ENTER:
+        case Opcode::PROFILE_EXIT:
+        case Opcode::LOOP_BUDGET:
+            next.push_back(pc + 1);
+            break;
+        case Opcode::LITERAL_TOO_LARGE:
+            // never falls through, but the stack entry it stands for is accounted for
+            after = d + 1;
+            next.push_back(pc + 1);
+            break;
+        case Opcode::HALT:
+            break;
+        }
+        for (size_t target : next)
+        {
+            if (target >= program.code.size())
+            {
+                continue;
+            }
+            if (depth[target] < 0)
+            {
+                depth[target] = after;
+                pending.push_back(target);
+            }
+            else if (depth[target] != after)
+            {
+                throw runtime_error("Inconsistent stack depth in bytecode");
+            }
+        }
+    }
+    return depth;
+}
+
+static vector<uint8_t> generateCode(const Bytecode &program)
+{
+    Assembler a;
+    vector<int> depths = stackDepths(program);
+    int32_t frame = (int32_t)((program.maxStackDepth * 4 + 15) & ~15);
+    auto entry = [](int index)
+    { return index * 4; };
+
+    // push rbx ; push r12 ; push r13 ; sub rsp, frame (keeps rsp 16-byte aligned for calls)
+    a.byte(0x53); a.byte(0x41); a.byte(0x54); a.byte(0x41); a.byte(0x55);
+    a.bytes3(0x48, 0x81, 0xEC); a.imm32(frame);
+    // mov r13, rdi ; mov rbx, [rdi + values] ; mov r12, [rdi + defined]
+    a.bytes3(0x49, 0x89, 0xFD);
+    a.bytes3(0x48, 0x8B, 0x9F); a.imm32(offsetof(NativeFrame, values));
+    a.bytes3(0x4C, 0x8B, 0xA7); a.imm32(offsetof(NativeFrame, defined));
+
+    vector<size_t> address(program.code.size());
+    vector<pair<size_t, int32_t>> jumps;        // displacement, target instruction
+    vector<pair<size_t, int32_t>> undefinedUses; // displacement, slot
+    vector<size_t> divisionsByZero, tooLarge, budgetExits, halts;
+
+    for (size_t pc = 0; pc < program.code.size(); pc++)
+    {
+        address[pc] = a.bytes.size();
+        const Instruction &in = program.code[pc];
+        int d = depths[pc];
+        if (d < 0)
+        {
+            continue; // unreachable
+        }
+        switch (in.op)
+        {
+        case Opcode::PUSH:
+        case Opcode::LOAD:
+        case Opcode::LOAD_CHECKED:
+            if (in.op == Opcode::LOAD_CHECKED)
+            {
+                a.cmpDefinedZero(in.operand);
+                undefinedUses.push_back({a.jumpIf(JUMP_IF_ZERO), in.operand});
+            }
+            if (d >= 1)
+            {
+                a.storeEaxToStack(entry(d - 1));
+            }
+            if (in.op == Opcode::PUSH)
+            {
+                a.movEaxImm(in.operand);
+            }
+            else
+            {
+                a.loadEaxFromVariable(in.operand);
+            }
+            break;
+        case Opcode::STORE:
+            a.storeEaxToVariable(in.operand);
+            a.setDefined(in.operand);
+            if (d >= 2)
+            {
+                a.loadEaxFromStack(entry(d - 2));
+            }
+            break;
+        case Opcode::KEEP:
+            a.storeEaxToVariable(in.operand); // the top stays in eax
+            break;
+        case Opcode::ADD:
+            a.addEaxStack(entry(d - 2));
+            break;
+        case Opcode::MULTIPLY:
+            a.imulEaxStack(entry(d - 2));
+            break;
+        case Opcode::SUBTRACT:
+            // left > right ? left - right : 0, with the left operand in ecx and the right in eax
+            a.loadEcxFromStack(entry(d - 2));
+            a.byte(0x89); a.byte(0xCA); // mov edx, ecx
+            a.byte(0x29); a.byte(0xC2); // sub edx, eax
+            a.byte(0x39); a.byte(0xC1); // cmp ecx, eax
+            a.movEaxImm(0);
+            a.bytes3(0x0F, 0x4F, 0xC2); // cmovg eax, edx
+            break;
+        case Opcode::DIVIDE:
+        {
+            a.testEaxEax();
+            divisionsByZero.push_back(a.jumpIf(JUMP_IF_ZERO));
+            a.byte(0x89); a.byte(0xC1); // mov ecx, eax
+            a.loadEaxFromStack(entry(d - 2));
+            a.bytes3(0x83, 0xF9, 0xFF); // cmp ecx, -1
+            size_t toDivide = a.jumpIf(JUMP_IF_NOT_ZERO);
+            a.byte(0xF7); a.byte(0xD8); // neg eax, since idiv traps on INT_MIN / -1
+            size_t toEnd = a.jump(0xE9);
+            a.patch(toDivide, a.bytes.size());
+            a.byte(0x99);               // cdq
+            a.byte(0xF7); a.byte(0xF9); // idiv ecx
+            a.patch(toEnd, a.bytes.size());
+            break;
+        }
+        case Opcode::JUMP:
+            jumps.push_back({a.jump(0xE9), in.operand});
+            break;
+        case Opcode::JUMP_IF_NOT_POSITIVE:
+            a.testEaxEax();
+            if (d >= 2)
+            {
+                a.loadEaxFromStack(entry(d - 2)); // mov leaves the flags alone
+            }
+            jumps.push_back({a.jumpIf(JUMP_IF_LESS_OR_EQUAL), in.operand});
+            break;
+        case Opcode::ACCELERATE:
+            // mov rdi, [r13 + program] ; mov esi, loop ; mov rax, accelerateFromNative ; call rax
+            a.bytes3(0x49, 0x8B, 0xBD); a.imm32(offsetof(NativeFrame, program));
+            a.byte(0xBE); a.imm32(in.operand);
+            a.byte(0x48); a.byte(0xB8); a.imm64((uint64_t)(uintptr_t)&accelerateFromNative);
+            a.byte(0xFF); a.byte(0xD0);
+            a.testEaxEax();
+            jumps.push_back({a.jumpIf(JUMP_IF_NOT_ZERO), program.loopExits[in.operand]});
+            break;
+        case Opcode::LOOP_BUDGET:
+        {
+            // sub dword [r13 + budgetTicks], 1 ; jns over the call while iterations are granted
+            a.bytes3(0x41, 0x83, 0xAD); a.imm32(offsetof(NativeFrame, budgetTicks)); a.byte(1);
+            size_t granted = a.jumpIf(JUMP_IF_NOT_SIGN);
+            // mov rdi, [r13 + program] ; mov esi, loop ; mov rax, budgetFromNative ; call rax
+            // (the body starts with an empty stack, so no value in eax is lost)
+            a.bytes3(0x49, 0x8B, 0xBD); a.imm32(offsetof(NativeFrame, program));
+            a.byte(0xBE); a.imm32(in.operand);
+            a.byte(0x48); a.byte(0xB8); a.imm64((uint64_t)(uintptr_t)&budgetFromNative);
+            a.byte(0xFF); a.byte(0xD0);
+            a.testEaxEax();
+            budgetExits.push_back(a.jumpIf(JUMP_IF_SIGN));
+            // mov [r13 + budgetTicks], eax
+            a.bytes3(0x41, 0x89, 0x85); a.imm32(offsetof(NativeFrame, budgetTicks));
+            a.patch(granted, a.bytes.size());
+            break;
+        }
+        case Opcode::PROFILE_ENTER:
+        case Opcode::PROFILE_EXIT:
+            break; // profiled programs run on the VirtualMachine, native code ignores the markers
+        case Opcode::LITERAL_TOO_LARGE:
+            tooLarge.push_back(a.jump(0xE9));
+            break;
+        case Opcode::HALT:
+            halts.push_back(a.jump(0xE9));
+            break;
+        }
+    }
+
+    for (auto &[displacement, target] : jumps)
+    {
+        a.patch(displacement, address[target]);
+    }
+
+    // error exits: mov eax, status (and the slot for undefined variables), then the epilogue
+    vector<size_t> toEpilogue;
+    for (auto &[displacement, variable] : undefinedUses)
+    {
+        a.patch(displacement, a.bytes.size());
+        a.bytes3(0x41, 0xC7, 0x85); a.imm32(offsetof(NativeFrame, errorSlot)); a.imm32(variable);
+        a.movEaxImm(NATIVE_UNDEFINED_VARIABLE);
+        toEpilogue.push_back(a.jump(0xE9));
+    }
+    auto exitWith = [&](const vector<size_t> &from, int32_t status)
+    {
+        if (from.empty())
+        {
+            return;
+        }
+        for (size_t displacement : from)
+        {
+            a.patch(displacement, a.bytes.size());
+        }
+        a.movEaxImm(status);
+        toEpilogue.push_back(a.jump(0xE9));
+    };
+    exitWith(divisionsByZero, NATIVE_DIVISION_BY_ZERO);
+    exitWith(tooLarge, NATIVE_LITERAL_TOO_LARGE);
+    exitWith(budgetExits, NATIVE_BUDGET_EXCEEDED);
+    exitWith(halts, NATIVE_OK);
+
+    for (size_t displacement : toEpilogue)
+    {
+        a.patch(displacement, a.bytes.size());
+    }
+    // add rsp, frame ; pop r13 ; pop r12 ; pop rbx ; ret
+    a.bytes3(0x48, 0x81, 0xC4); a.imm32(frame);
+    a.byte(0x41); a.byte(0x5D); a.byte(0x41); a.byte(0x5C); a.byte(0x5B); a.byte(0xC3);
+    return a.bytes;
+}
+
+#endif
+
+NativeProgram::NativeProgram(const Bytecode &bytecode, ExecutionBudget *budget)
+    : program(bytecode),
+      values(bytecode.slotNames.size() + bytecode.temporaries, 0),
+      defined(bytecode.slotNames.size() + bytecode.temporaries, 0),
+      reported(bytecode.loops.size(), 0),
+      budget(budget)
+{
+#if LIMP_JIT_SUPPORTED
+    vector<uint8_t> machineCode = generateCode(program);
+    size = machineCode.size();
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    mappedSize = (size + page - 1) / page * page;
+    void *buffer = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        throw runtime_error("Could not allocate memory for native code");
+    }
+    memcpy(buffer, machineCode.data(), size);
+    // never writable and executable at the same time
+    if (mprotect(buffer, mappedSize, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(buffer, mappedSize);
+        throw runtime_error("Could not make native code executable");
+    }
+    code = buffer;
+#else
+    throw runtime_error("Native code generation is only available on x86-64 Linux");
+#endif
+}
+
+NativeProgram::~NativeProgram()
+{
+#if LIMP_JIT_SUPPORTED
+    if (code)
+    {
+        munmap(code, mappedSize);
+    }
+#endif
+}
+
+void NativeProgram::run()
+{
+    if (budget)
+    {
+        // the native code never allocates while it runs, so this does not change
+        budget->measureMemoryWith([this]()
+                                  { return values.capacity() * sizeof(int) + defined.capacity() + reported.capacity() +
+                                           (size_t)program.maxStackDepth * 4; });
+        budget->start();
+    }
+    NativeFrame frame{values.data(), defined.data(), this, -1, 0};
+    auto entry = (int32_t(*)(NativeFrame *))code;
+    switch (entry(&frame))
+    {
+    case NATIVE_DIVISION_BY_ZERO:
+        throw runtime_error("Division by zero");
+    case NATIVE_UNDEFINED_VARIABLE:
+        throw runtime_error("Undefined variable: " + program.slotNames[frame.errorSlot]);
+    case NATIVE_LITERAL_TOO_LARGE:
+        // the same exception stoi used to throw for this literal
+        throw out_of_range("stoi");
+    case NATIVE_BUDGET_EXCEEDED:
+        rethrow_exception(stopped);
+    default:
+        break;
+    }
+}
+
+map<string, int> NativeProgram::getMemory() const
+{
+    map<string, int> memory;
+    for (size_t slot = 0; slot < program.slotNames.size(); slot++)
+    {
+        if (defined[slot])
+        {
+            memory[program.slotNames[slot]] = values[slot];
+        }
+    }
+    return memory;
+}
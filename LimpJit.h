@@ -0,0 +1,59 @@
+#ifndef LIMP_JIT_H
+#define LIMP_JIT_H
+
+#include "LimpBytecode.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <exception>
+#include <cstdint>
+
+using namespace std;
+
+// Whether this build can generate native code (x86-64 Linux only)
+bool jitSupported();
+
+/*
+The operand stack of the generated code lives in its native stack frame, so programs whose
+expressions need more entries than this (a million nested parentheses, say) are left to the
+VirtualMachine, whose stack is on the heap.
+*/
+const int MAX_NATIVE_STACK_DEPTH = 1 << 18;
+
+/*
+A compiled Bytecode program translated to x86-64 machine code, one instruction template per
+bytecode instruction, in a buffer of its own that is mapped executable once it is written.
+It behaves exactly like the VirtualMachine it is built from: same arithmetic, same errors
+(thrown from run once the native code has returned), same final memory.
+*/
+class NativeProgram
+{
+public:
+    NativeProgram(const Bytecode &program, ExecutionBudget *budget = nullptr);
+    ~NativeProgram();
+    NativeProgram(const NativeProgram &) = delete;
+    NativeProgram &operator=(const NativeProgram &) = delete;
+
+    void run();
+
+    map<string, int> getMemory() const;
+
+    // Size of the generated machine code in bytes
+    size_t codeSize() const { return size; }
+
+private:
+    const Bytecode &program;
+    vector<int> values;
+    vector<uint8_t> defined;
+    vector<uint8_t> reported; // per loop, whether its acceleration was logged already
+    void *code = nullptr;
+    size_t size = 0;
+    size_t mappedSize = 0;
+    ExecutionBudget *budget;
+    exception_ptr stopped; // NATIVE_BUDGET_EXCEEDED: what budgetFromNative caught
+
+    friend int accelerateFromNative(NativeProgram *self, int32_t loop);
+    friend int budgetFromNative(NativeProgram *self, int32_t loop);
+};
+
+#endif
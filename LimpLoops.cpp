@@ -0,0 +1,230 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Loop acceleration for Limp
+Description: This module recognizes counting loops such as
+
+                 while x - y do z := z + y ; y := y + 1 endwhile
+
+             whose body only adds loop invariants to induction variables and induction
+             variables to accumulators. When such a loop is reached, its trip count follows
+             from the condition and the final value of every variable from a closed formula,
+             so both the VirtualMachine and the Evaluator can skip all of its iterations.
+             Updates wrap around exactly like limpAdd does (the formulas are computed in 128 bits
+             and truncated); the condition operands are only accepted while they stay in
+             [0, INT_MAX], where a - b cannot wrap and "a - b > 0" is simply "a > b".
+*/
+
+#include "LimpLoops.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+__extension__ typedef __int128 wide;
+
+static bool operandOf(const AST &ast, const VariableSlots &slots, NodeId node, LoopOperand &operand)
+{
+    const ASTnode &n = ast[node];
+    if (n.kind == NodeKind::IDENTIFIER)
+    {
+        operand = LoopOperand{slots.slotOf(ast, node), 0};
+        return true;
+    }
+    if (n.kind == NodeKind::NUMBER && !n.literalTooLarge)
+    {
+        operand = LoopOperand{-1, n.value};
+        return true;
+    }
+    return false;
+}
+
+static int updateOf(const AffineLoop &loop, int32_t slot)
+{
+    for (size_t i = 0; i < loop.updates.size(); i++)
+    {
+        if (loop.updates[i].slot == slot)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static string operandText(const VariableSlots &slots, const LoopOperand &operand)
+{
+    return operand.slot >= 0 ? slots.names[operand.slot] : to_string(operand.constant);
+}
+
+bool analyzeAffineLoop(const AST &ast, const VariableSlots &slots, NodeId whileNode, AffineLoop &loop)
+{
+    const ASTnode &w = ast[whileNode];
+    const ASTnode &condition = ast[w.left];
+    loop = AffineLoop();
+    loop.loop = whileNode;
+    if (condition.kind != NodeKind::MINUS || !operandOf(ast, slots, condition.left, loop.left) ||
+        !operandOf(ast, slots, condition.right, loop.right))
+    {
+        return false;
+    }
+
+    // the statements of the body in execution order
+    vector<NodeId> pending{w.right};
+    while (!pending.empty())
+    {
+        NodeId statement = pending.back();
+        pending.pop_back();
+        const ASTnode &s = ast[statement];
+        if (s.kind == NodeKind::SEQUENCE)
+        {
+            StatementBlock statements = ast.block(statement);
+            for (size_t i = statements.size(); i-- > 0;)
+            {
+                pending.push_back(statements[i]);
+            }
+            continue;
+        }
+        if (s.kind != NodeKind::ASSIGN || ast[s.right].kind != NodeKind::PLUS)
+        {
+            return false;
+        }
+        const ASTnode &sum = ast[s.right];
+        LoopOperand first, second;
+        if (!operandOf(ast, slots, sum.left, first) || !operandOf(ast, slots, sum.right, second))
+        {
+            return false;
+        }
+        LoopUpdate update;
+        update.slot = slots.slotOf(ast, s.left);
+        if (first.slot == update.slot && second.slot != update.slot)
+        {
+            update.step = second;
+        }
+        else if (second.slot == update.slot && first.slot != update.slot)
+        {
+            update.step = first;
+        }
+        else
+        {
+            return false;
+        }
+        if (updateOf(loop, update.slot) >= 0)
+        {
+            return false;
+        }
+        loop.updates.push_back(update);
+    }
+
+    for (size_t i = 0; i < loop.updates.size(); i++)
+    {
+        LoopUpdate &update = loop.updates[i];
+        int source = update.step.slot >= 0 ? updateOf(loop, update.step.slot) : -1;
+        if (source < 0)
+        {
+            continue; // steps by an invariant
+        }
+        const LoopUpdate &induction = loop.updates[source];
+        if (induction.step.slot >= 0 && updateOf(loop, induction.step.slot) >= 0)
+        {
+            return false; // would be a cubic or worse
+        }
+        update.induction = source;
+        update.readsUpdated = source < (int)i;
+    }
+
+    for (const LoopOperand &operand : {loop.left, loop.right})
+    {
+        int update = operand.slot >= 0 ? updateOf(loop, operand.slot) : -1;
+        if (update >= 0 && loop.updates[update].induction >= 0)
+        {
+            return false; // the condition has to be linear in the iteration number
+        }
+    }
+
+    for (const LoopUpdate &update : loop.updates)
+    {
+        loop.readSlots.push_back(update.slot);
+        if (update.step.slot >= 0)
+        {
+            loop.readSlots.push_back(update.step.slot);
+        }
+    }
+    for (const LoopOperand &operand : {loop.left, loop.right})
+    {
+        if (operand.slot >= 0)
+        {
+            loop.readSlots.push_back(operand.slot);
+        }
+    }
+    sort(loop.readSlots.begin(), loop.readSlots.end());
+    loop.readSlots.erase(unique(loop.readSlots.begin(), loop.readSlots.end()), loop.readSlots.end());
+
+    loop.description = "while " + operandText(slots, loop.left) + " - " + operandText(slots, loop.right);
+    return true;
+}
+
+bool runAffineLoop(const AffineLoop &loop, int *values, int64_t &trips)
+{
+    auto valueOf = [&](const LoopOperand &operand) -> wide
+    {
+        return operand.slot >= 0 ? values[operand.slot] : operand.constant;
+    };
+    auto stepOf = [&](const LoopOperand &operand) -> wide
+    {
+        int update = operand.slot >= 0 ? updateOf(loop, operand.slot) : -1;
+        return update >= 0 ? valueOf(loop.updates[update].step) : 0;
+    };
+
+    wide left = valueOf(loop.left);
+    wide right = valueOf(loop.right);
+    if (left < 0 || right < 0 || left <= right)
+    {
+        return false;
+    }
+    // the gap left - right has to shrink on every iteration for the loop to end
+    wide closing = stepOf(loop.right) - stepOf(loop.left);
+    if (closing <= 0)
+    {
+        return false;
+    }
+    wide n = (left - right + closing - 1) / closing;
+    // both operands move linearly, so staying in range at the first and last test covers every test
+    wide lastLeft = left + n * stepOf(loop.left);
+    wide lastRight = right + n * stepOf(loop.right);
+    if (lastLeft < 0 || lastLeft > INT32_MAX || lastRight < 0 || lastRight > INT32_MAX)
+    {
+        return false;
+    }
+
+    // every formula uses the values on entry, so compute them all before storing any
+    vector<int> results(loop.updates.size());
+    for (size_t i = 0; i < loop.updates.size(); i++)
+    {
+        const LoopUpdate &update = loop.updates[i];
+        wide result = values[update.slot];
+        if (update.induction < 0)
+        {
+            result += n * valueOf(update.step);
+        }
+        else
+        {
+            // the added variable takes the values first, first + d, ..., first + (n - 1) d
+            const LoopUpdate &induction = loop.updates[update.induction];
+            wide d = valueOf(induction.step);
+            wide first = values[induction.slot] + (update.readsUpdated ? d : 0);
+            result += n * first + d * (n * (n - 1) / 2);
+        }
+        results[i] = (int)(uint32_t)result;
+    }
+    for (size_t i = 0; i < loop.updates.size(); i++)
+    {
+        values[loop.updates[i].slot] = results[i];
+    }
+    trips = (int64_t)n;
+    return true;
+}
+
+void reportAcceleratedLoop(const AffineLoop &loop, int64_t trips)
+{
+    cerr << "Accelerated loop \"" << loop.description << "\": " << trips << " iterations in closed form" << endl;
+}
@@ -0,0 +1,68 @@
+#ifndef LIMP_LOOPS_H
+#define LIMP_LOOPS_H
+
+#include "LimpParser.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// A variable (slot >= 0) or a literal (slot < 0, value in constant)
+struct LoopOperand
+{
+    int32_t slot;
+    int32_t constant;
+};
+
+/*
+One statement v := v + step of the loop body.
+An induction variable steps by a literal or a variable the loop never assigns.
+An accumulator steps by an induction variable, read before or after that variable's
+own update depending on which statement comes first in the body.
+*/
+struct LoopUpdate
+{
+    int32_t slot;
+    LoopOperand step;
+    int induction = -1;         // accumulator: index in AffineLoop::updates of the variable it adds
+    bool readsUpdated = false;  // accumulator: that variable is updated earlier in the body
+};
+
+/*
+A while loop of the form
+
+    while a - b do v1 := v1 + s1 ; ... ; vk := vk + sk endwhile
+
+where a and b are literals, loop invariants or induction variables, and every update is
+one of the LoopUpdate forms with each variable assigned once. Such a loop runs
+ceil((a - b) / (step of b - step of a)) times and every variable ends up at a value
+given by a closed formula, so runAffineLoop can apply all iterations at once.
+*/
+struct AffineLoop
+{
+    NodeId loop = NO_NODE;
+    LoopOperand left;
+    LoopOperand right;
+    vector<LoopUpdate> updates;
+    vector<int32_t> readSlots; // every variable the loop reads, all must be defined on entry
+    string description;        // "while x - y" for the log
+};
+
+// Fills loop and returns true when the WHILE node at whileNode has the affine form above
+bool analyzeAffineLoop(const AST &ast, const VariableSlots &slots, NodeId whileNode, AffineLoop &loop);
+
+/*
+Runs all remaining iterations of the loop on values (indexed by slot), as if it was stepped
+through one iteration at a time, and stores the iteration count in trips.
+The caller must have checked that every slot of loop.readSlots is defined.
+Returns false without touching values when that cannot be done exactly: the loop would not
+terminate, the condition operands would leave the range where a - b cannot wrap around,
+or it would not run at all. The loop then has to be executed normally.
+*/
+bool runAffineLoop(const AffineLoop &loop, int *values, int64_t &trips);
+
+// Writes the "Accelerated ..." line for the loop to the console
+void reportAcceleratedLoop(const AffineLoop &loop, int64_t trips);
+
+#endif
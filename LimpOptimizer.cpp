@@ -0,0 +1,184 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Optimizer for Limp
+Description: This module simplifies the Limp AST before it is evaluated.
+             Constant folding evaluates subtrees made only of literals with exactly the
+             arithmetic the evaluator uses (LimpArithmetic.h), so loops stop recomputing them
+             on every iteration. Nodes are rewritten in place: children always come before their
+             parents in the arena, so one pass in index order sees every child already simplified.
+*/
+
+#include "LimpOptimizer.h"
+#include "LimpArithmetic.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static bool isConstant(const ASTnode &node)
+{
+    return node.kind == NodeKind::NUMBER && !node.literalTooLarge;
+}
+
+static bool isConstantEqualTo(const ASTnode &node, int value)
+{
+    return isConstant(node) && node.value == value;
+}
+
+static void makeNumber(AST &ast, NodeId id, int value)
+{
+    ASTnode &node = ast[id];
+    node.kind = NodeKind::NUMBER;
+    node.literalTooLarge = false;
+    node.value = value;
+    node.left = node.right = node.extra = NO_NODE;
+    node.symbol = ast.intern(to_string(value));
+}
+
+// Makes the node at id a copy of one of its descendants, which keeps its own children
+static void replaceWith(AST &ast, NodeId id, NodeId descendant)
+{
+    ast[id] = ast[descendant];
+}
+
+static size_t countReachableNodes(const AST &ast)
+{
+    if (ast.root == NO_NODE)
+    {
+        return 0;
+    }
+    // parents have larger indices than their children, so one downward pass marks everything
+    vector<uint8_t> reachable(ast.nodes.size(), 0);
+    reachable[ast.root] = 1;
+    size_t count = 0;
+    for (NodeId id = ast.root + 1; id-- > 0;)
+    {
+        if (!reachable[id])
+        {
+            continue;
+        }
+        count++;
+        const ASTnode &node = ast[id];
+        for (NodeId child : {node.left, node.right, node.extra})
+        {
+            if (child != NO_NODE)
+            {
+                reachable[child] = 1;
+            }
+        }
+        if (node.kind == NodeKind::SEQUENCE)
+        {
+            for (NodeId statement : ast.block(id))
+            {
+                reachable[statement] = 1;
+            }
+        }
+    }
+    return count;
+}
+
+int foldConstants(AST &ast)
+{
+    size_t before = countReachableNodes(ast);
+    // mayFail[id]: evaluating the expression at id can raise an error (undefined variable,
+    // division by zero, oversized literal), so it must not be dropped by an identity like 0 * x
+    vector<uint8_t> mayFail(ast.nodes.size(), 0);
+
+    for (NodeId id = 0; id < ast.nodes.size(); id++)
+    {
+        ASTnode node = ast[id];
+        switch (node.kind)
+        {
+        case NodeKind::NUMBER:
+            mayFail[id] = node.literalTooLarge;
+            break;
+        case NodeKind::IDENTIFIER:
+            mayFail[id] = 1;
+            break;
+        case NodeKind::PLUS:
+        case NodeKind::MINUS:
+        case NodeKind::TIMES:
+        case NodeKind::DIVIDE:
+        {
+            const ASTnode &left = ast[node.left];
+            const ASTnode &right = ast[node.right];
+            bool divisionMayFail = node.kind == NodeKind::DIVIDE && !(isConstant(right) && right.value != 0);
+            if (isConstant(left) && isConstant(right) && !divisionMayFail)
+            {
+                int value = node.kind == NodeKind::PLUS    ? limpAdd(left.value, right.value)
+                            : node.kind == NodeKind::MINUS ? limpSubtract(left.value, right.value)
+                            : node.kind == NodeKind::TIMES ? limpMultiply(left.value, right.value)
+                                                           : limpDivide(left.value, right.value);
+                makeNumber(ast, id, value);
+                break;
+            }
+            mayFail[id] = mayFail[node.left] || mayFail[node.right] || divisionMayFail;
+
+            /*
+            x - 0 is not an identity: a value that wrapped around to a negative number becomes 0
+            */
+            if (node.kind == NodeKind::PLUS && isConstantEqualTo(right, 0))
+            {
+                replaceWith(ast, id, node.left);
+            }
+            else if (node.kind == NodeKind::PLUS && isConstantEqualTo(left, 0))
+            {
+                replaceWith(ast, id, node.right);
+            }
+            else if ((node.kind == NodeKind::TIMES || node.kind == NodeKind::DIVIDE) && isConstantEqualTo(right, 1))
+            {
+                replaceWith(ast, id, node.left);
+            }
+            else if (node.kind == NodeKind::TIMES && isConstantEqualTo(left, 1))
+            {
+                replaceWith(ast, id, node.right);
+            }
+            else if (node.kind == NodeKind::TIMES && ((isConstantEqualTo(right, 0) && !mayFail[node.left])
+                                                      || (isConstantEqualTo(left, 0) && !mayFail[node.right])))
+            {
+                makeNumber(ast, id, 0);
+                mayFail[id] = 0;
+            }
+            break;
+        }
+        case NodeKind::SEQUENCE:
+        {
+            // the skips leave the block, which closes up in place
+            NodeId *statements = ast.blocks.data() + node.symbol;
+            NodeId first = statements[0];
+            NodeId *kept = remove_if(statements, statements + node.value,
+                                     [&](NodeId statement) { return ast[statement].kind == NodeKind::SKIP; });
+            if (kept == statements)
+            {
+                replaceWith(ast, id, first); // only skips, which one skip does as well
+            }
+            else if (kept - statements == 1)
+            {
+                replaceWith(ast, id, statements[0]);
+            }
+            else
+            {
+                ast[id].value = (int32_t)(kept - statements);
+            }
+            break;
+        }
+        case NodeKind::IF:
+            if (isConstant(ast[node.left]))
+            {
+                replaceWith(ast, id, ast[node.left].value > 0 ? node.right : node.extra);
+            }
+            break;
+        case NodeKind::WHILE:
+            if (isConstant(ast[node.left]) && ast[node.left].value <= 0)
+            {
+                ast[id] = ASTnode{NodeKind::SKIP, false, 0, 0, NO_NODE, NO_NODE, NO_NODE, node.line, node.column};
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return (int)(before - countReachableNodes(ast));
+}
@@ -0,0 +1,15 @@
+#ifndef LIMP_OPTIMIZER_H
+#define LIMP_OPTIMIZER_H
+
+#include "LimpParser.h"
+
+/*
+Folds literal-only subexpressions and applies identities that cannot change what the
+program does (x + 0, x * 1, x / 1, skip in a sequence, if/while with a literal condition).
+Divisions by a literal zero, literals too large for an int and anything that reads
+a variable are left alone, so every runtime error still happens when it used to.
+The AST is rewritten in place; returns how many nodes are no longer reachable from the root.
+*/
+int foldConstants(AST &ast);
+
+#endif
@@ -6,83 +6,17 @@ Description: This program implements a parser module for Limp.
              according to the language grammar.  
              The output of the parser is an Abstract Syntax Tree (AST) (a preorder traverse)
              that represents the parsed code structure.  
+             Neither parsing nor printing recurses, so arbitrarily deep nesting is fine.
 */
 
-#include "LimpScanner.h"
+#include "LimpParser.h"
 #include <iostream>
-#include <regex>
 #include <string>
 #include <fstream>
 #include <vector>
 
 using namespace std;
 
-const regex IDENTIFIER_REGEX("^[a-zA-Z][a-zA-Z0-9]*");
-const regex NUMBER_REGEX("^[0-9]+");
-const regex SYMBOL_REGEX(R"(\+|\-|\*|\/|\(|\)|\;|\:=)");
-const regex KEYWORD_REGEX(R"(\b(if|then|else|endif|while|do|endwhile|skip)\b)");
-const regex WHITESPACE_REGEX(R"(\s+)");
-
-struct ASTnode
-{
-    string value;
-    string type;
-    shared_ptr<ASTnode> left;
-    shared_ptr<ASTnode> right;
-    shared_ptr<ASTnode> clone() const {
-        /*
-        First, create a new ASTnode with the same value and type with the current node, null pointer for left and right
-        If the current node has a left child (not nullptr),
-        it calls clone() on that left child and assigns the result to the new node's left pointer.
-        Similarly, if there's a right child,
-        it calls clone() on that right child and assigns the result to the new node's right pointer.
-        */
-        auto newNode = make_shared<ASTnode>(value, type);
-        if (left) newNode->left = left->clone();
-        if (right) newNode->right = right->clone();
-        return newNode;
-    }
-
-    ASTnode(string val, string t, shared_ptr<ASTnode> l = nullptr, shared_ptr<ASTnode> r = nullptr)
-        : value(val), type(t), left(l), right(r) {}
-};
-
-class TokenStream
-{
-public:
-    vector<Token> tokens;
-    size_t index = 0;
-
-    TokenStream(vector<Token> token) : tokens(std::move(token)) {}
-    // move(token) transfer token's contents to tokens without copying
-    // it allows resources to be moved instead of copied
-    // after the move, token is left in a valid but unspecified state
-
-    Token peek()
-    {
-        if (index < tokens.size())
-        {
-            return tokens[index]; // return the current token
-        }
-        else
-        {
-            return Token{"End of File", ""};
-        }
-    }
-
-    Token get()
-    {
-        if (index < tokens.size())
-        {
-            return tokens[index++]; // return the current token then increase the index by 1
-        }
-        else
-        {
-            return Token{"End of File", ""};
-        }
-    }
-};
-
 /*
 Grammar of Limp is defined as follows:
 statement ::= basestatement { ; basestatement }
@@ -98,312 +32,414 @@ piece ::= element { * element }
 element ::= ( expression ) | NUMBER | IDENTIFIER
 */
 
-shared_ptr<ASTnode> parseStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseBaseStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseAssignment(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseIfStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseWhileStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseExpression(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseTerm(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseFactor(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parsePiece(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseElement(TokenStream &tokens, ofstream &outputFile);
-
-shared_ptr<ASTnode> parseStatement(TokenStream &tokens, ofstream &outputFile)
+// Stops parsing with a syntax error; the caller reports it (see ParseError)
+[[noreturn]] static void parseError(const string &message)
 {
-    auto node = parseBaseStatement(tokens, outputFile);
-    while (tokens.peek().value == ";")
-    {
-        tokens.get();
-        node = make_shared<ASTnode>(";", "SYMBOL", node, parseBaseStatement(tokens, outputFile));
-    }
-    return node;
+    throw ParseError("ERROR IN PARSER: " + message);
 }
 
-shared_ptr<ASTnode> parseBaseStatement(TokenStream &tokens, ofstream &outputFile)
-{
-    Token token = tokens.peek();
-    if (token.type == "IDENTIFIER")
-    {
-        return parseAssignment(tokens, outputFile);
-    }
-    else if (token.value == "if")
-    {
-        return parseIfStatement(tokens, outputFile);
-    }
-    else if (token.value == "while")
-    {
-        return parseWhileStatement(tokens, outputFile);
-    }
-    else if (token.value == "skip")
-    {
-        tokens.get();
-        return make_shared<ASTnode>("skip", "KEYWORD");
-    }
-    outputFile << "ERROR IN PARSER: Unexpected statement: " << token.value << endl;
-    outputFile.close();
-    exit(1);
-}
+/*
+Neither statements nor expressions are parsed by recursion: nested statements and parentheses
+keep their state on explicit stacks, so their depth is only limited by memory. The trees are
+the ones the grammar above describes, and their nodes are created in the same order a
+recursive descent parser would create them (every node after its children).
+*/
 
-shared_ptr<ASTnode> parseAssignment(TokenStream &tokens, ofstream &outputFile)
+static int precedence(TokenCode code)
 {
-    Token id = tokens.get();
-    if (tokens.get().value != ":=")
+    switch (code)
     {
-        outputFile << "ERROR IN PARSER: Expected ':=' symbol in assignment \"" << id.value << "\""<< endl;
-        outputFile.close();
-        exit(1);
+    case TokenCode::PLUS:
+        return 1;
+    case TokenCode::MINUS:
+        return 2;
+    case TokenCode::DIVIDE:
+        return 3;
+    case TokenCode::TIMES:
+        return 4;
+    default:
+        return 0;
     }
-    return make_shared<ASTnode>(":=", "SYMBOL", make_shared<ASTnode>(id.value, "IDENTIFIER"), parseExpression(tokens, outputFile));
 }
 
-shared_ptr<ASTnode> parseIfStatement(TokenStream &tokens, ofstream &outputFile)
+static NodeKind operatorKind(TokenCode code)
 {
-    tokens.get();
-    auto condition = parseExpression(tokens, outputFile);
-    if (tokens.get().value != "then")
+    switch (code)
     {
-        outputFile << "ERROR IN PARSER: Expected 'then' in if statement, but found \"" << tokens.peek().value << "\" instead."<< endl;
-        outputFile.close();
-        exit(1);
+    case TokenCode::PLUS:
+        return NodeKind::PLUS;
+    case TokenCode::MINUS:
+        return NodeKind::MINUS;
+    case TokenCode::DIVIDE:
+        return NodeKind::DIVIDE;
+    default:
+        return NodeKind::TIMES;
     }
-
-    auto thenBranch = parseStatement(tokens, outputFile);
-    if (tokens.get().value != "else")
-    {
-        outputFile << "ERROR IN PARSER: Expected 'else' in if statement, but found \"" << tokens.peek().value << "\" instead."<< endl;
-        outputFile.close();
-        exit(1);
-    }
-
-    auto elseBranch = parseStatement(tokens, outputFile);
-    if (tokens.get().value != "endif")
-    {
-        outputFile << "ERROR IN PARSER: Expected 'endif' in if statement, but found \"" << tokens.peek().value << "\" instead."<< endl;
-        outputFile.close();
-        exit(1);
-    }
-
-    // Create a special structure for the AST to handle the if statement's three branches
-    auto ifNode = make_shared<ASTnode>("if", "IF-STATEMENT");
-    ifNode->left = condition;
-    // Create a dummy node to hold the then and else branches
-    auto dummyNode = make_shared<ASTnode>("", "");
-    dummyNode->left = thenBranch;
-    dummyNode->right = elseBranch;
-
-    ifNode->right = dummyNode;
-
-    return ifNode;
 }
 
-shared_ptr<ASTnode> parseWhileStatement(TokenStream &tokens, ofstream &outputFile)
+/*
+Precedence climbing: each grammar level is left-associative, + binds loosest and * tightest.
+pending holds the operators still waiting for their right operand, and the open parentheses
+(precedence 0), which stop an operator from taking an operand from outside them.
+*/
+struct ExpressionStacks
 {
-    // Consume "while"
-    tokens.get();
-    auto condition = parseExpression(tokens, outputFile);
-
-    Token doToken = tokens.peek();
-    if (doToken.value != "do")
-    {
-        outputFile << "ERROR IN PARSER: Expected 'do' in while statement, but found \"" << doToken.value << "\" instead." << endl;
-        outputFile.close();
-        exit(1);
-    }
-    // Consume "do"
-    tokens.get();
-
-    auto body = parseStatement(tokens, outputFile);
-    Token endToken = tokens.peek();
-    if (endToken.value != "endwhile")
-    {
-        outputFile << "ERROR IN PARSER: Expected 'endwhile' to close while loop but found \"" << endToken.value << "\" instead." << endl;
-        outputFile.close();
-        exit(1);
-    }
-    // Consume "endwhile"
-    tokens.get();
-
-    return make_shared<ASTnode>("while", "WHILE-LOOP", condition, body);
-}
+    vector<TokenCode> pending;
+    vector<NodeId> operands;
+};
 
-shared_ptr<ASTnode> parseExpression(TokenStream &tokens, ofstream &outputFile)
+// parseStatement passes the same stacks for every expression, which saves allocating them each time
+static NodeId parseExpression(TokenStream &tokens, AST &ast, ExpressionStacks &stacks)
 {
-    if (tokens.peek().value == ")")
+    vector<TokenCode> &pending = stacks.pending;
+    vector<NodeId> &operands = stacks.operands;
+    pending.clear();
+    operands.clear();
+
+    // replaces the two operands on top of the stack by the operator node joining them
+    auto reduce = [&]()
     {
-        outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-        outputFile.close();
-        exit(1);
-    }
+        NodeId right = operands.back();
+        operands.pop_back();
+        operands.back() = ast.addOperator(operatorKind(pending.back()), operands.back(), right);
+        pending.pop_back();
+    };
 
-    auto node = parseTerm(tokens, outputFile);
-    while (tokens.peek().value == "+")
+    for (;;)
     {
-        tokens.get();
+        // element ::= ( expression ) | NUMBER | IDENTIFIER
+        Token token = tokens.get();
+        if (token.code == TokenCode::LPAREN)
+        {
+            pending.push_back(TokenCode::LPAREN);
+            continue;
+        }
+        if (token.kind == TokenKind::NUMBER)
+        {
+            operands.push_back(ast.addNumber(token));
+        }
+        else if (token.kind == TokenKind::IDENTIFIER)
+        {
+            operands.push_back(ast.addIdentifier(token));
+        }
+        else if (token.code == TokenCode::RPAREN)
+        {
+            parseError("Unexpected closing parenthesis with no matching opening parenthesis");
+        }
+        else
+        {
+            parseError("Unexpected token: " + string(token.value));
+        }
 
-        if (tokens.peek().value == ")")
+        // after an operand: an operator continues the expression, anything else ends it
+        for (;;)
         {
-            outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-            outputFile.close();
-            exit(1);
+            int level = precedence(tokens.peek().code);
+            if (level > 0)
+            {
+                while (!pending.empty() && precedence(pending.back()) >= level)
+                {
+                    reduce();
+                }
+                pending.push_back(tokens.get().code);
+                break;
+            }
+            while (!pending.empty() && pending.back() != TokenCode::LPAREN)
+            {
+                reduce();
+            }
+            if (pending.empty())
+            {
+                return operands.back();
+            }
+            // the innermost parenthesized expression is complete
+            token = tokens.get();
+            if (token.code != TokenCode::RPAREN)
+            {
+                parseError("Expected closing parenthesis but only found: " + string(token.value));
+            }
+            pending.pop_back();
         }
-        node = make_shared<ASTnode>("+", "SYMBOL", node, parseTerm(tokens, outputFile));
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseTerm(TokenStream &tokens, ofstream &outputFile)
+NodeId parseExpression(TokenStream &tokens, AST &ast)
 {
-    if (tokens.peek().value == ")")
+    ExpressionStacks stacks;
+    return parseExpression(tokens, ast, stacks);
+}
+
+// assignment ::= IDENTIFIER := expression
+static NodeId parseAssignment(TokenStream &tokens, AST &ast, ExpressionStacks &stacks)
+{
+    Token id = tokens.get();
+    if (tokens.get().code != TokenCode::ASSIGN)
     {
-        outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-        outputFile.close();
-        exit(1);
+        parseError("Expected ':=' symbol in assignment \"" + string(id.value) + "\"");
     }
+    NodeId target = ast.addIdentifier(id);
+    NodeId assignment = ast.addNode(NodeKind::ASSIGN, target, parseExpression(tokens, ast, stacks));
+    ast.setPosition(assignment, id);
+    return assignment;
+}
 
-    auto node = parseFactor(tokens, outputFile);
-    while (tokens.peek().value == "-")
-    {
-        tokens.get();
+/*
+A statement whose parsing is not finished. STATEMENT collects the ';'-separated base
+statements of one statement, which become one SEQUENCE node once it is complete; the others
+are an if or a while statement waiting for the statement that makes up its next part.
+*/
+struct OpenStatement
+{
+    enum Kind
+    {
+        STATEMENT,
+        THEN_BRANCH,
+        ELSE_BRANCH,
+        WHILE_BODY
+    } kind;
+    NodeId first;  // STATEMENT: where its base statements start in the collected ones, otherwise the condition
+    NodeId second; // ELSE_BRANCH: the then branch
+    Token keyword{}; // the 'if' or 'while' the statement starts with
+};
 
-        if (tokens.peek().value == ")")
+NodeId parseStatement(TokenStream &tokens, AST &ast)
+{
+    vector<OpenStatement> open;
+    vector<NodeId> collected; // the base statements of the open STATEMENTs, innermost last
+    ExpressionStacks stacks;
+    auto openStatement = [&]() { open.push_back(OpenStatement{OpenStatement::STATEMENT, (NodeId)collected.size(), NO_NODE}); };
+    openStatement();
+
+    for (;;)
+    {
+        // basestatement ::= assignment | ifstatement | whilestatement | skip
+        Token token = tokens.peek();
+        NodeId node;
+        if (token.kind == TokenKind::IDENTIFIER)
+        {
+            node = parseAssignment(tokens, ast, stacks);
+        }
+        else if (token.code == TokenCode::SKIP)
+        {
+            tokens.get();
+            node = ast.addNode(NodeKind::SKIP);
+            ast.setPosition(node, token);
+        }
+        else if (token.code == TokenCode::IF)
         {
-            outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-            outputFile.close();
-            exit(1);
+            tokens.get();
+            NodeId condition = parseExpression(tokens, ast, stacks);
+            if (tokens.get().code != TokenCode::THEN)
+            {
+                parseError("Expected 'then' in if statement, but found \"" + string(tokens.peek().value) + "\" instead.");
+            }
+            open.push_back(OpenStatement{OpenStatement::THEN_BRANCH, condition, NO_NODE, token});
+            openStatement();
+            continue;
+        }
+        else if (token.code == TokenCode::WHILE)
+        {
+            tokens.get();
+            NodeId condition = parseExpression(tokens, ast, stacks);
+            const Token &doToken = tokens.peek();
+            if (doToken.code != TokenCode::DO)
+            {
+                parseError("Expected 'do' in while statement, but found \"" + string(doToken.value) + "\" instead.");
+            }
+            tokens.get();
+            open.push_back(OpenStatement{OpenStatement::WHILE_BODY, condition, NO_NODE, token});
+            openStatement();
+            continue;
+        }
+        else
+        {
+            parseError("Unexpected statement: " + string(token.value));
         }
 
-        node = make_shared<ASTnode>("-", "SYMBOL", node, parseFactor(tokens, outputFile));
+        // node is a complete base statement: add it to the innermost statement
+        for (;;)
+        {
+            collected.push_back(node);
+            if (tokens.peek().code == TokenCode::SEMICOLON)
+            {
+                tokens.get();
+                break;
+            }
+
+            // the statement is complete, so is the part of the if or while it belongs to
+            const NodeId *first = collected.data() + open.back().first;
+            const NodeId *last = collected.data() + collected.size();
+            node = last - first == 1 ? *first : ast.addBlock(first, last);
+            collected.resize(open.back().first);
+            open.pop_back();
+            if (open.empty())
+            {
+                return node;
+            }
+            OpenStatement &owner = open.back();
+            if (owner.kind == OpenStatement::THEN_BRANCH)
+            {
+                if (tokens.get().code != TokenCode::ELSE)
+                {
+                    parseError("Expected 'else' in if statement, but found \"" + string(tokens.peek().value) + "\" instead.");
+                }
+                owner.kind = OpenStatement::ELSE_BRANCH;
+                owner.second = node;
+                openStatement();
+                break;
+            }
+            if (owner.kind == OpenStatement::ELSE_BRANCH)
+            {
+                if (tokens.get().code != TokenCode::ENDIF)
+                {
+                    parseError("Expected 'endif' in if statement, but found \"" + string(tokens.peek().value) + "\" instead.");
+                }
+                // The if node keeps all three parts, the else branch goes into the extra child
+                node = ast.addNode(NodeKind::IF, owner.first, owner.second, node);
+                ast.setPosition(node, owner.keyword);
+            }
+            else
+            {
+                const Token &endToken = tokens.peek();
+                if (endToken.code != TokenCode::ENDWHILE)
+                {
+                    parseError("Expected 'endwhile' to close while loop but found \"" + string(endToken.value) + "\" instead.");
+                }
+                tokens.get();
+                node = ast.addNode(NodeKind::WHILE, owner.first, node);
+                ast.setPosition(node, owner.keyword);
+            }
+            open.pop_back();
+        }
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseFactor(TokenStream &tokens, ofstream &outputFile)
+VariableSlots resolveVariables(const AST &ast)
 {
-    if (tokens.peek().value == ")")
-    {
-        outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-        outputFile.close();
-        exit(1);
-    }
-
-    auto node = parsePiece(tokens, outputFile);
-    while (tokens.peek().value == "/")
+    VariableSlots slots;
+    slots.symbolSlot.assign(ast.names.size(), -1);
+    // children come before their parents in the arena, so this is close to source order
+    for (const ASTnode &node : ast.nodes)
     {
-        tokens.get();
-
-        if (tokens.peek().value == ")")
+        if (node.kind == NodeKind::IDENTIFIER && slots.symbolSlot[node.symbol] < 0)
         {
-            outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-            outputFile.close();
-            exit(1);
+            slots.symbolSlot[node.symbol] = (int32_t)slots.names.size();
+            slots.names.push_back(ast.names[node.symbol]);
         }
-
-        node = make_shared<ASTnode>("/", "SYMBOL", node, parsePiece(tokens, outputFile));
     }
-    return node;
+    return slots;
 }
 
-shared_ptr<ASTnode> parsePiece(TokenStream &tokens, ofstream &outputFile)
+// Name printed for the node in the "TYPE VALUE" lines of the AST dump
+static string_view nodeTypeName(NodeKind kind)
 {
-    if (tokens.peek().value == ")")
-    {
-        outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-        outputFile.close();
-        exit(1);
+    switch (kind)
+    {
+    case NodeKind::NUMBER:
+        return "NUMBER";
+    case NodeKind::IDENTIFIER:
+        return "IDENTIFIER";
+    case NodeKind::SKIP:
+        return "KEYWORD";
+    case NodeKind::IF:
+        return "IF-STATEMENT";
+    case NodeKind::WHILE:
+        return "WHILE-LOOP";
+    default:
+        return "SYMBOL";
     }
+}
 
-    auto node = parseElement(tokens, outputFile);
-    while (tokens.peek().value == "*")
-    {
-        tokens.get();
-
-        if (tokens.peek().value == ")")
-        {
-            outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-            outputFile.close();
-            exit(1);
-        }
-
-        node = make_shared<ASTnode>("*", "SYMBOL", node, parseElement(tokens, outputFile));
+static string_view nodeSymbol(NodeKind kind)
+{
+    switch (kind)
+    {
+    case NodeKind::PLUS:
+        return "+";
+    case NodeKind::MINUS:
+        return "-";
+    case NodeKind::TIMES:
+        return "*";
+    case NodeKind::DIVIDE:
+        return "/";
+    case NodeKind::ASSIGN:
+        return ":=";
+    case NodeKind::SEQUENCE:
+        return ";";
+    case NodeKind::SKIP:
+        return "skip";
+    default:
+        return "";
     }
-    return node;
 }
 
-shared_ptr<ASTnode> parseElement(TokenStream &tokens, ofstream &outputFile)
+void forEachASTLine(const AST &ast, NodeId node, const function<void(const ASTLine &)> &visit, int depth)
 {
-    Token token = tokens.get();
-    if (token.type == "NUMBER" || token.type == "IDENTIFIER")
+    // pre-order with an explicit stack, so long statement chains do not overflow the call stack
+    vector<pair<NodeId, int>> stack;
+    if (node != NO_NODE)
     {
-        return make_shared<ASTnode>(token.value, token.type);
+        stack.push_back({node, depth});
     }
-    else if (token.value == "(")
+    while (!stack.empty())
     {
-        auto node = parseExpression(tokens, outputFile);
-
-        token = tokens.get();
-        if (token.value != ")")
+        auto [id, level] = stack.back();
+        stack.pop_back();
+        const ASTnode &n = ast[id];
+        if (n.kind == NodeKind::SEQUENCE)
+        {
+            /*
+            Printed as the left-deep chain of ';' it stands for: statements s1 ; ... ; sn are
+            n - 1 ';' lines, each one level deeper than the one before, then s1 and s2 under the
+            innermost ';' and each later statement one level less deep than the one before it.
+            */
+            StatementBlock statements = ast.block(id);
+            size_t count = statements.size();
+            for (size_t i = 0; i + 1 < count; i++)
+            {
+                visit(ASTLine{level + (int)i, id, "SYMBOL", ";"});
+            }
+            for (size_t i = count; i-- > 1;)
+            {
+                stack.push_back({statements[i], level + (int)(count - i)});
+            }
+            stack.push_back({statements[0], level + (int)count - 1});
+            continue;
+        }
+        bool hasName = n.kind == NodeKind::NUMBER || n.kind == NodeKind::IDENTIFIER;
+        visit(ASTLine{level, id, nodeTypeName(n.kind), hasName ? string_view(ast.name(id)) : nodeSymbol(n.kind)});
+        // children one level deeper, pushed last to first so they come out in order
+        // (an if has its condition, then branch and else branch, in that order)
+        for (NodeId child : {n.extra, n.right, n.left})
         {
-            outputFile << "ERROR IN PARSER: Expected closing parenthesis but only found: " << token.value << endl;
-            outputFile.close();
-            exit(1);
+            if (child != NO_NODE)
+            {
+                stack.push_back({child, level + 1});
+            }
         }
-        return node;
     }
-    else if (token.value == ")")
-    {
-        outputFile << "ERROR IN PARSER: Unexpected closing parenthesis with no matching opening parenthesis" << endl;
-        outputFile.close();
-        exit(1);
-    }
-
-    outputFile << "ERROR IN PARSER: Unexpected token: " << token.value << endl;
-    outputFile.close();
-    exit(1);
 }
 
-void printAST(const shared_ptr<ASTnode> &node, ofstream &outputFile, int depth = 0)
+void printAST(const AST &ast, NodeId node, ostream &outputFile, int depth)
 {
-    if (!node)
-        return;
-
-    // Special case for the dummy node in IF-STATEMENT
-    if (node->type == "" && node->value == "")
-    {
-        // This is the dummy node holding the then and else branches
-        // Print both branches at the current depth
-        printAST(node->left, outputFile, depth);
-        printAST(node->right, outputFile, depth);
-        return;
-    }
-    if (node->value == "if")
+    // "TYPE VALUE" lines, indented from a row of blanks rather than a string made for every line
+    static const char blanks[] = "                                ";
+    forEachASTLine(ast, node, [&](const ASTLine &line)
     {
-        outputFile << string(depth * 4, ' ') << node->type << endl;
-        printAST(node->left, outputFile, depth + 1); // Print condition
-
-        // Check if right child is our special dummy node
-        if (node->right && node->right->type == "" && node->right->value == "")
+        for (size_t indent = (size_t)line.depth * 4; indent > 0;)
         {
-            // Print the then and else branches directly at the correct depth
-            printAST(node->right->left, outputFile, depth + 1);
-            printAST(node->right->right, outputFile, depth + 1);
-            return; // Skip the normal right child processing
+            size_t part = min(indent, sizeof(blanks) - 1);
+            outputFile.write(blanks, (streamsize)part);
+            indent -= part;
         }
-    }
-    else if (node->value == "while")
-    {
-        outputFile << string(depth * 4, ' ') << node->type << endl;
-        printAST(node->left, outputFile, depth + 1);
-        printAST(node->right, outputFile, depth + 1);
-        return;
-    }
-    else
-    {
-        // General case: print "TYPE VALUE"
-        outputFile << string(depth * 4, ' ') << node->type << " " << node->value << endl;
-        printAST(node->left, outputFile, depth + 1);
-        printAST(node->right, outputFile, depth + 1);
-    }
+        outputFile << line.type;
+        NodeKind kind = ast[line.node].kind;
+        if (kind != NodeKind::IF && kind != NodeKind::WHILE)
+        {
+            outputFile << ' ' << line.text;
+        }
+        outputFile << '\n';
+    }, depth);
 }
 
 /*
@@ -445,13 +481,13 @@ int main(int argc, char *argv[])
 
         for (const Token &token : tokens)
         {
-            if (token.type == "ERROR READING")
+            if (token.kind == TokenKind::ERROR)
             {
-                outputFile << "ERROR READING: \"" + token.value + "\"" << endl;
+                outputFile << "ERROR READING: \"" << token.value << "\"" << endl;
             }
             else
             {
-                outputFile << token.value << ": " << token.type << endl;
+                outputFile << token.value << ": " << tokenKindName(token.kind) << endl;
             }
         }
         fullInput += line + " ";
@@ -459,9 +495,10 @@ int main(int argc, char *argv[])
 
     vector<Token> tokens = scanLine(fullInput);
     TokenStream ts(tokens);
-    shared_ptr<ASTnode> root = parseStatement(ts, outputFile);
+    AST ast;
+    ast.root = parseStatement(ts, ast, outputFile);
     Token nextToken = ts.peek();
-    if (nextToken.type != "End of File")
+    if (nextToken.kind != TokenKind::END_OF_FILE)
     {
         outputFile << "ERROR IN PARSER: Unexpected token: \"" << nextToken.value << "\" after expression"<< endl;
         outputFile << endl;
@@ -471,7 +508,7 @@ int main(int argc, char *argv[])
 
     outputFile << endl;
     outputFile << "AST:" << endl;
-    printAST(root, outputFile);
+    printAST(ast, ast.root, outputFile);
     outputFile << endl;
 
     inputFile.close();
@@ -3,76 +3,364 @@
 
 #include "LimpScanner.h"
 #include <string>
+#include <string_view>
 #include <vector>
-#include <fstream>
-#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
+// Nodes refer to each other by their index in AST::nodes
+typedef uint32_t NodeId;
+const NodeId NO_NODE = UINT32_MAX;
+
+enum class NodeKind : uint8_t
+{
+    NUMBER,
+    IDENTIFIER,
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE,   // the kinds up to here are expressions, which are shared (see AST)
+    ASSIGN,   // left = IDENTIFIER, right = expression
+    SEQUENCE, // two or more statements separated by ';', kept in AST::blocks (see AST::block)
+    IF,       // left = condition, right = then branch, extra = else branch
+    WHILE,    // left = condition, right = body
+    SKIP
+};
+
 struct ASTnode
 {
-    string value;
-    string type;
-    shared_ptr<ASTnode> left;
-    shared_ptr<ASTnode> right;
-    shared_ptr<ASTnode> clone() const {
-        auto newNode = make_shared<ASTnode>(value, type);
-        if (left) newNode->left = left->clone();
-        if (right) newNode->right = right->clone();
-        return newNode;
-    }
-
-    ASTnode(string val, string t, shared_ptr<ASTnode> l = nullptr, shared_ptr<ASTnode> r = nullptr)
-        : value(val), type(t), left(l), right(r) {}
+    NodeKind kind;
+    bool literalTooLarge; // NUMBER whose digits do not fit in an int
+    uint32_t symbol;      // NUMBER and IDENTIFIER: index of the spelling in AST::names, SEQUENCE: of its first statement in AST::blocks
+    int32_t value;        // NUMBER: the literal, parsed once by the parser, SEQUENCE: the number of statements
+    NodeId left;
+    NodeId right;
+    NodeId extra;
+    uint32_t line;        // where the node starts in the source (see Token), 0 if it has no source
+    uint32_t column;
 };
 
-class TokenStream
+// The statements of a SEQUENCE node, in order
+struct StatementBlock
+{
+    const NodeId *first;
+    const NodeId *last;
+
+    const NodeId *begin() const { return first; }
+    const NodeId *end() const { return last; }
+    size_t size() const { return last - first; }
+    NodeId operator[](size_t i) const { return first[i]; }
+};
+
+/*
+All nodes of a program live contiguously in one vector and refer to their children
+by index, so building a tree costs no allocation per node and the whole tree goes away
+with the vector. Identifier names and number spellings are interned into names, which
+lets the evaluators compare identifiers by symbol instead of by string.
+Children are always created before their parent, so a child's index is smaller
+than its parent's index.
+Expressions are hash-consed: structurally equal expressions are one node, which every
+occurrence refers to (see addShared), so the nodes form a DAG and a repeated subexpression
+costs nothing more; within one AST, two expressions are equal exactly when their ids are.
+An expression node keeps the position of its first occurrence. Statements are never shared.
+A run of statements separated by ';' is one SEQUENCE node whose statements lie side by side
+in blocks, so a program of many statements is a flat list rather than a chain as deep as it is long.
+*/
+class AST
 {
 public:
-    vector<Token> tokens;
-    size_t index = 0;
+    vector<ASTnode> nodes;
+    vector<string> names;
+    /*
+    Open-addressing hash table of symbols (indices into names), EMPTY where free. Looking a
+    spelling up compares it with names directly, so interning a name seen before allocates nothing.
+    */
+    vector<uint32_t> nameTable;
+    vector<NodeId> blocks;
+    // Open-addressing hash table of the shared expression nodes, NO_NODE where free (see addShared)
+    vector<NodeId> nodeTable;
+    NodeId root = NO_NODE;
 
-    TokenStream(vector<Token> token) : tokens(std::move(token)) {}
-    // move(token) transfer token's contents to tokens without copying
-    // it allows resources to be moved instead of copied
-    // after the move, token is left in a valid but unspecified state
+    const ASTnode &operator[](NodeId id) const { return nodes[id]; }
+    ASTnode &operator[](NodeId id) { return nodes[id]; }
+
+    NodeId addNode(NodeKind kind, NodeId left = NO_NODE, NodeId right = NO_NODE, NodeId extra = NO_NODE)
+    {
+        nodes.push_back(ASTnode{kind, false, 0, 0, left, right, extra, 0, 0});
+        return (NodeId)(nodes.size() - 1);
+    }
+
+    // Records that the node starts where the token does
+    void setPosition(NodeId id, const Token &token)
+    {
+        nodes[id].line = token.line;
+        nodes[id].column = token.column;
+    }
+
+    // Records that the node starts where the node from does (an operator where its left operand starts, a SEQUENCE where its first statement does)
+    void copyPosition(NodeId id, NodeId from)
+    {
+        nodes[id].line = nodes[from].line;
+        nodes[id].column = nodes[from].column;
+    }
+
+    // A SEQUENCE of the given statements, which must be two or more
+    NodeId addBlock(const NodeId *first, const NodeId *last)
+    {
+        NodeId id = addNode(NodeKind::SEQUENCE);
+        nodes[id].symbol = (uint32_t)blocks.size();
+        nodes[id].value = (int32_t)(last - first);
+        blocks.insert(blocks.end(), first, last);
+        copyPosition(id, *first);
+        return id;
+    }
+
+    StatementBlock block(NodeId id) const
+    {
+        const NodeId *first = blocks.data() + nodes[id].symbol;
+        return StatementBlock{first, first + nodes[id].value};
+    }
+
+    // The IDENTIFIER node of the token's name
+    NodeId addIdentifier(const Token &token)
+    {
+        return addShared(ASTnode{NodeKind::IDENTIFIER, false, intern(token.value), 0, NO_NODE, NO_NODE, NO_NODE, token.line, token.column});
+    }
+
+    // The NUMBER node of the token's digits
+    NodeId addNumber(const Token &token)
+    {
+        ASTnode node{NodeKind::NUMBER, false, intern(token.value), 0, NO_NODE, NO_NODE, NO_NODE, token.line, token.column};
+        int64_t value = 0;
+        for (char c : token.value)
+        {
+            value = value * 10 + (c - '0');
+            if (value > INT32_MAX)
+            {
+                node.literalTooLarge = true;
+                break;
+            }
+        }
+        node.value = (int32_t)value;
+        return addShared(node);
+    }
+
+    // The PLUS, MINUS, TIMES or DIVIDE node of the two operands, which starts where its left operand does
+    NodeId addOperator(NodeKind kind, NodeId left, NodeId right)
+    {
+        return addShared(ASTnode{kind, false, 0, 0, left, right, NO_NODE, nodes[left].line, nodes[left].column});
+    }
+
+    /*
+    Hash of an expression node from its kind, its spelling and the ids of its operands. As the
+    operands are shared themselves, equal ids stand for equal subtrees, so this is a hash of the
+    whole subtree computed in constant time. It depends on nothing but the node (no addresses and
+    no std::hash), so the same program hashes the same on every run and every platform.
+    */
+    static uint64_t structuralHash(const ASTnode &node)
+    {
+        uint64_t h = ((uint64_t)node.kind << 32 | node.symbol) * 0x9E3779B97F4A7C15ULL;
+        h ^= ((uint64_t)node.left << 32 | node.right) * 0xC2B2AE3D27D4EB4FULL;
+        return h ^ (h >> 31);
+    }
+
+    /*
+    The expression node equal to node if the tree has one, otherwise node added to the tree.
+    Expression nodes are only rewritten by the optimizer once parsing is done, which changes
+    every occurrence alike; no node may be added after that.
+    */
+    NodeId addShared(const ASTnode &node)
+    {
+        if (nodes.size() * 2 >= nodeTable.size())
+        {
+            growNodeTable();
+        }
+        size_t mask = nodeTable.size() - 1;
+        for (size_t i = structuralHash(node) & mask;; i = (i + 1) & mask)
+        {
+            NodeId id = nodeTable[i];
+            if (id == NO_NODE)
+            {
+                nodes.push_back(node);
+                nodeTable[i] = (NodeId)(nodes.size() - 1);
+                return nodeTable[i];
+            }
+            const ASTnode &other = nodes[id];
+            if (other.kind == node.kind && other.symbol == node.symbol && other.left == node.left && other.right == node.right)
+            {
+                return id;
+            }
+        }
+    }
 
-    Token peek()
+    uint32_t intern(string_view text)
     {
-        if (index < tokens.size())
+        if (names.size() * 2 >= nameTable.size())
         {
-            return tokens[index]; // return the current token
+            growNameTable();
         }
-        else
+        size_t mask = nameTable.size() - 1;
+        for (size_t i = hash<string_view>()(text) & mask;; i = (i + 1) & mask)
         {
-            return Token{"End of File", ""};
+            uint32_t symbol = nameTable[i];
+            if (symbol == EMPTY)
+            {
+                nameTable[i] = (uint32_t)names.size();
+                names.emplace_back(text);
+                return nameTable[i];
+            }
+            if (names[symbol] == text)
+            {
+                return symbol;
+            }
         }
     }
 
+    const string &name(NodeId id) const { return names[nodes[id].symbol]; }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    void growNameTable()
+    {
+        nameTable.assign(max<size_t>(16, nameTable.size() * 2), EMPTY);
+        size_t mask = nameTable.size() - 1;
+        for (uint32_t symbol = 0; symbol < names.size(); symbol++)
+        {
+            size_t i = hash<string_view>()(names[symbol]) & mask;
+            while (nameTable[i] != EMPTY)
+            {
+                i = (i + 1) & mask;
+            }
+            nameTable[i] = symbol;
+        }
+    }
+
+    void growNodeTable()
+    {
+        nodeTable.assign(max<size_t>(16, nodeTable.size() * 2), NO_NODE);
+        size_t mask = nodeTable.size() - 1;
+        for (NodeId id = 0; id < nodes.size(); id++)
+        {
+            if (nodes[id].kind > NodeKind::DIVIDE)
+            {
+                continue; // a statement
+            }
+            size_t i = structuralHash(nodes[id]) & mask;
+            while (nodeTable[i] != NO_NODE)
+            {
+                i = (i + 1) & mask;
+            }
+            nodeTable[i] = id;
+        }
+    }
+};
+
+/*
+Numbers every distinct variable of a program with a dense slot index, in order of first
+appearance, so evaluators can keep variables in a flat array instead of a map keyed by name.
+symbolSlot[symbol] is the slot of the identifier interned as symbol (-1 for number spellings).
+*/
+struct VariableSlots
+{
+    vector<int32_t> symbolSlot;
+    vector<string> names;
+
+    int32_t slotOf(const AST &ast, NodeId identifier) const { return symbolSlot[ast[identifier].symbol]; }
+};
+
+VariableSlots resolveVariables(const AST &ast);
+
+/*
+The tokens the parser reads, pulled from a Scanner one at a time with one token of lookahead,
+so a program's tokens are never all in memory. Every token scanned is also handed to onToken
+(the interpreter writes the token list from it), and finish() scans what the parser left so the
+list is complete. The parser's stream ends after the first ERROR token, even though the token
+list goes on with the next line.
+*/
+class TokenStream
+{
+public:
+    explicit TokenStream(Scanner &scanner, function<void(const Token &)> onToken = nullptr)
+        : scanner(scanner), onToken(std::move(onToken))
+    {
+        current = pull();
+    }
+
+    // The next token, which stays the next token until get
+    const Token &peek() const { return current; }
+
     Token get()
     {
-        if (index < tokens.size())
+        Token token = current;
+        if (token.kind == TokenKind::ERROR)
         {
-            return tokens[index++]; // return the current token then increase the index by 1
+            current = Token{TokenKind::END_OF_FILE, TokenCode::NONE, ""};
         }
-        else
+        else if (token.kind != TokenKind::END_OF_FILE)
+        {
+            current = pull();
+        }
+        return token;
+    }
+
+    // Scans the rest of the source for onToken
+    void finish()
+    {
+        while (pull().kind != TokenKind::END_OF_FILE)
+        {
+        }
+    }
+
+private:
+    Scanner &scanner;
+    function<void(const Token &)> onToken;
+    Token current;
+
+    Token pull()
+    {
+        Token token = scanner.next();
+        if (token.kind != TokenKind::END_OF_FILE && onToken)
         {
-            return Token{"End of File", ""};
+            onToken(token);
         }
+        return token;
     }
 };
 
-shared_ptr<ASTnode> parseStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseBaseStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseAssignment(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseIfStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseWhileStatement(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseExpression(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseTerm(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseFactor(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parsePiece(TokenStream &tokens, ofstream &outputFile);
-shared_ptr<ASTnode> parseElement(TokenStream &tokens, ofstream &outputFile);
+/*
+A syntax error. what() is the "ERROR IN PARSER: ..." line to report; the interpreter writes it
+to the output file and stops, the server (see LimpServer.cpp) answers the request with it.
+*/
+class ParseError : public runtime_error
+{
+public:
+    explicit ParseError(const string &message) : runtime_error(message) {}
+};
+
+NodeId parseStatement(TokenStream &tokens, AST &ast);
+NodeId parseExpression(TokenStream &tokens, AST &ast);
+
+/*
+One line of printAST: "type text" at depth. The IF and WHILE nodes have no text; a block is
+printed as the chain of ';' it stands for, whose "SYMBOL ;" lines all have the SEQUENCE node.
+*/
+struct ASTLine
+{
+    int depth;
+    NodeId node;
+    string_view type;
+    string_view text;
+};
+
+// Calls visit with every line printAST writes for the tree under node, in the same order
+void forEachASTLine(const AST &ast, NodeId node, const function<void(const ASTLine &)> &visit, int depth = 0);
 
-void printAST(const shared_ptr<ASTnode> &node, ofstream &outputFile, int depth = 0);
+void printAST(const AST &ast, NodeId node, ostream &outputFile, int depth = 0);
 
-#endif 
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,319 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Profiler for Limp
+Description: This module attributes the execution of a Limp program to its source statements.
+             The bytecode compiler marks the statements (see ProfileMode), the VirtualMachine
+             reports them to the Profiler as it runs, and the Profiler prints the hot spots
+             with their source positions and writes a folded stack file for flame graphs.
+*/
+
+#include "LimpProfiler.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/time.h>
+#define LIMP_SAMPLING_SUPPORTED 1
+#else
+#define LIMP_SAMPLING_SUPPORTED 0
+#endif
+
+using namespace std;
+
+const int SAMPLE_INTERVAL_MICROSECONDS = 1000;
+
+bool samplingSupported()
+{
+    return LIMP_SAMPLING_SUPPORTED;
+}
+
+// The profiler the timer signal samples; one program is profiled at a time
+static Profiler *volatile sampledProfiler = nullptr;
+
+#if LIMP_SAMPLING_SUPPORTED
+static void onProfilingTimer(int)
+{
+    Profiler *profiler = sampledProfiler;
+    if (profiler)
+    {
+        profiler->takeSample();
+    }
+}
+#endif
+
+// The start of the statement's source line from its column, up to the next ';', at most 40 characters
+static string sourceLabel(const vector<string> &lines, const ASTnode &node)
+{
+    string text;
+    if (node.line >= 1 && node.line <= lines.size() && node.column >= 1)
+    {
+        const string &line = lines[node.line - 1];
+        size_t start = min<size_t>(node.column - 1, line.size());
+        size_t end = min(line.find(';', start), start + 41);
+        text = line.substr(start, end == string::npos ? string::npos : end - start);
+        while (!text.empty() && isspace((unsigned char)text.back()))
+        {
+            text.pop_back();
+        }
+        if (text.size() > 40)
+        {
+            text = text.substr(0, 37) + "...";
+        }
+    }
+    return text + " (" + to_string(node.line) + ":" + to_string(node.column) + ")";
+}
+
+Profiler::Profiler(const AST &ast, string_view source, ProfileMode mode)
+    : profileMode(mode), statementOf(ast.nodes.size(), -1)
+{
+    vector<string> lines;
+    size_t start = 0;
+    for (size_t end; (end = source.find('\n', start)) != string::npos; start = end + 1)
+    {
+        lines.emplace_back(source.substr(start, end - start));
+    }
+    lines.emplace_back(source.substr(start));
+
+    // pre-order from the root, so statements come in source order and after their parent
+    vector<pair<NodeId, int32_t>> pending;
+    if (ast.root != NO_NODE)
+    {
+        pending.push_back({ast.root, -1});
+    }
+    while (!pending.empty())
+    {
+        auto [node, parent] = pending.back();
+        pending.pop_back();
+        const ASTnode &n = ast[node];
+        if (n.kind == NodeKind::SEQUENCE)
+        {
+            StatementBlock statements = ast.block(node);
+            for (size_t i = statements.size(); i-- > 0;)
+            {
+                pending.push_back({statements[i], parent});
+            }
+            continue;
+        }
+        int32_t index = (int32_t)statements.size();
+        statementOf[node] = index;
+        statements.push_back(Statement{node, parent, sourceLabel(lines, n)});
+        if (n.kind == NodeKind::IF)
+        {
+            pending.push_back({n.extra, index});
+            pending.push_back({n.right, index});
+        }
+        else if (n.kind == NodeKind::WHILE)
+        {
+            pending.push_back({n.right, index});
+        }
+    }
+}
+
+Profiler::~Profiler()
+{
+    finish();
+}
+
+void Profiler::enter(NodeId node)
+{
+    open.push_back(OpenStatement{statementOf[node], chrono::steady_clock::now()});
+}
+
+void Profiler::leave()
+{
+    OpenStatement statement = open.back();
+    open.pop_back();
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - statement.start;
+    statements[statement.statement].count++;
+    statements[statement.statement].totalNanoseconds += elapsed.count();
+}
+
+void Profiler::takeSample()
+{
+    const Bytecode *program = sampledProgram;
+    const VirtualMachine *vm = sampledMachine;
+    const Instruction *running = vm ? vm->running : nullptr;
+    if (!running)
+    {
+        return;
+    }
+    NodeId node = program->statementAt[running - program->code.data()];
+    if (node != NO_NODE)
+    {
+        statements[statementOf[node]].samples++;
+    }
+}
+
+void Profiler::start()
+{
+    if (profileMode != ProfileMode::SAMPLE)
+    {
+        return;
+    }
+#if LIMP_SAMPLING_SUPPORTED
+    sampledProfiler = this;
+    struct sigaction action = {};
+    action.sa_handler = onProfilingTimer;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, nullptr);
+    // ITIMER_PROF counts the CPU time of the process, so time spent waiting is not sampled
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = SAMPLE_INTERVAL_MICROSECONDS;
+    timer.it_value.tv_usec = SAMPLE_INTERVAL_MICROSECONDS;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    samplingStart = clock();
+    sampling = true;
+#else
+    throw runtime_error("Sampling profiles need setitimer, which this system does not have");
+#endif
+}
+
+void Profiler::finish()
+{
+#if LIMP_SAMPLING_SUPPORTED
+    if (sampling)
+    {
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        signal(SIGPROF, SIG_IGN);
+        sampledMilliseconds = (double)(clock() - samplingStart) * 1000 / CLOCKS_PER_SEC;
+        sampledProfiler = nullptr;
+        sampledMachine = nullptr;
+        sampling = false;
+    }
+#endif
+    while (!open.empty())
+    {
+        leave();
+    }
+}
+
+vector<double> Profiler::selfValues() const
+{
+    vector<double> self(statements.size());
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        self[i] = profileMode == ProfileMode::SAMPLE ? (double)statements[i].samples : statements[i].totalNanoseconds / 1000;
+    }
+    if (profileMode != ProfileMode::SAMPLE)
+    {
+        for (const Statement &statement : statements)
+        {
+            if (statement.parent >= 0)
+            {
+                self[statement.parent] -= statement.totalNanoseconds / 1000;
+            }
+        }
+    }
+    return self;
+}
+
+vector<double> Profiler::totalValues() const
+{
+    vector<double> total(statements.size());
+    if (profileMode == ProfileMode::SAMPLE)
+    {
+        // children come after their parent, so adding from the back gives each parent its whole subtree
+        for (size_t i = statements.size(); i-- > 0;)
+        {
+            total[i] += (double)statements[i].samples;
+            if (statements[i].parent >= 0)
+            {
+                total[statements[i].parent] += total[i];
+            }
+        }
+        return total;
+    }
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        total[i] = statements[i].totalNanoseconds / 1000;
+    }
+    return total;
+}
+
+string Profiler::stackOf(int32_t statement) const
+{
+    string stack = statements[statement].label;
+    for (int32_t parent = statements[statement].parent; parent >= 0; parent = statements[parent].parent)
+    {
+        stack = statements[parent].label + ";" + stack;
+    }
+    return stack;
+}
+
+void Profiler::writeReport(ostream &out, size_t limit) const
+{
+    vector<double> self = selfValues();
+    vector<double> total = totalValues();
+    double whole = 0;
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        if (statements[i].parent < 0)
+        {
+            whole += total[i];
+        }
+    }
+
+    vector<size_t> order;
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        if (total[i] > 0 || statements[i].count > 0)
+        {
+            order.push_back(i);
+        }
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return self[a] > self[b]; });
+    if (order.size() > limit)
+    {
+        order.resize(limit);
+    }
+
+    /*
+    The timer ticks at the system's clock resolution, which may be coarser than asked for, so the
+    time of a sample is the CPU time of the run divided by the samples taken rather than the interval.
+    */
+    bool sampled = profileMode == ProfileMode::SAMPLE;
+    double toMilliseconds = sampled ? (whole > 0 ? sampledMilliseconds / whole : 0) : 1.0 / 1000;
+    out << "Profile (" << fixed << setprecision(3) << whole * toMilliseconds << " ms, ";
+    if (sampled)
+    {
+        out << (long long)whole << " samples of the CPU time";
+    }
+    else
+    {
+        out << "every statement timed";
+    }
+    out << "), hottest statements first:" << endl;
+    out << "  " << setw(12) << (sampled ? "samples" : "count") << setw(12) << "self ms" << setw(9) << "self %"
+        << setw(12) << "total ms" << setw(9) << "total %" << "  statement" << endl;
+    for (size_t i : order)
+    {
+        out << "  " << setw(12) << (sampled ? statements[i].samples : statements[i].count)
+            << setw(12) << setprecision(3) << self[i] * toMilliseconds
+            << setw(8) << setprecision(1) << (whole > 0 ? self[i] / whole * 100 : 0) << "%"
+            << setw(12) << setprecision(3) << total[i] * toMilliseconds
+            << setw(8) << setprecision(1) << (whole > 0 ? total[i] / whole * 100 : 0) << "%"
+            << "  " << statements[i].label << endl;
+    }
+    out << defaultfloat;
+}
+
+void Profiler::writeFoldedStacks(ostream &out) const
+{
+    vector<double> self = selfValues();
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        long long value = (long long)(self[i] + 0.5);
+        if (value > 0)
+        {
+            out << stackOf((int32_t)i) << " " << value << "\n";
+        }
+    }
+}
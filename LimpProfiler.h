@@ -0,0 +1,97 @@
+#ifndef LIMP_PROFILER_H
+#define LIMP_PROFILER_H
+
+#include "LimpBytecode.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <ostream>
+#include <cstdint>
+
+using namespace std;
+
+// Whether this system has the profiling timer SAMPLE needs (setitimer and SIGPROF)
+bool samplingSupported();
+
+/*
+The execution profile of one run of a program on the VirtualMachine, per source statement
+(assignment, if, while or skip; a ';' is not a statement of its own). A statement's total time
+includes the statements nested in it, its self time does not.
+*/
+class Profiler
+{
+public:
+    // source is the program text the AST was parsed from, to label the statements
+    Profiler(const AST &ast, string_view source, ProfileMode mode);
+    ~Profiler();
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    ProfileMode mode() const { return profileMode; }
+
+    // EXACT: the statement at node starts and the innermost one started last ends
+    void enter(NodeId node);
+    void leave();
+
+    // SAMPLE: the timer signal samples the instruction vm is running in program
+    void sample(const Bytecode &program, const VirtualMachine &vm)
+    {
+        sampledProgram = &program;
+        sampledMachine = &vm;
+    }
+
+    // Starts the sampling timer in SAMPLE mode
+    void start();
+
+    // Stops the timer, and ends the statements an error left running
+    void finish();
+
+    // The statements with the most self time, hottest first
+    void writeReport(ostream &out, size_t limit = 20) const;
+
+    /*
+    One "outer;inner;statement value" line per statement that ran, the value being its self
+    time in microseconds (EXACT) or its sample count (SAMPLE): the folded stack format
+    flamegraph.pl and speedscope read.
+    */
+    void writeFoldedStacks(ostream &out) const;
+
+    void takeSample();
+
+private:
+    struct Statement
+    {
+        NodeId node;
+        int32_t parent; // index of the enclosing if or while, -1 at the top level
+        string label;   // "while i - 10 (3:1)"
+        uint64_t count = 0;
+        double totalNanoseconds = 0;
+        uint64_t samples = 0; // SAMPLE: while the statement itself was running
+    };
+
+    struct OpenStatement
+    {
+        int32_t statement;
+        chrono::steady_clock::time_point start;
+    };
+
+    ProfileMode profileMode;
+    vector<Statement> statements; // in source order
+    vector<int32_t> statementOf;  // per node, the index in statements, -1 for nodes that are not statements
+    vector<OpenStatement> open;
+    bool sampling = false;
+    clock_t samplingStart = 0;
+    double sampledMilliseconds = 0; // CPU time the samples were taken over
+    const Bytecode *volatile sampledProgram = nullptr;
+    const VirtualMachine *volatile sampledMachine = nullptr;
+
+    // Per statement, the value flame graphs show: self time in microseconds, or self samples
+    vector<double> selfValues() const;
+    // Per statement, self plus everything nested in it
+    vector<double> totalValues() const;
+    string stackOf(int32_t statement) const;
+};
+
+#endif
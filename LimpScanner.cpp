@@ -3,82 +3,267 @@ Name: Hoang Mai Han Dang, Yazi Zhang
 Phase 1.2: Scanner for Limp
 Description: This program implements a lexical scanner for Limp,
              identifying keywords, identifiers, numbers, and symbols.
+             The Scanner hands out one token at a time, as the parser asks for them.
 */
 
+#include "LimpScanner.h"
 #include <iostream>
-#include <regex>
 #include <string>
 #include <fstream>
 #include <vector>
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LIMP_SCANNER_MMAP 1
+#else
+#define LIMP_SCANNER_MMAP 0
+#endif
 
 using namespace std;
- 
-const regex IDENTIFIER_REGEX("^[a-zA-Z][a-zA-Z0-9]*");
-const regex NUMBER_REGEX("^[0-9]+");
-const regex SYMBOL_REGEX(R"(\+|\-|\*|\/|\(|\)|\;|\:=)");
-const regex KEYWORD_REGEX(R"(\b(if|then|else|endif|while|do|endwhile|skip)\b)");
-const regex WHITESPACE_REGEX(R"(\s+)");
-
-struct Token {
-    string type;
-    string value;
+
+/*
+The scanner is a hand-written DFA: every byte is classified once through CHAR_CLASS
+and the scanner stays in one state (identifier, number, symbol, whitespace) until
+a byte of another class shows up. This replaces the earlier cascade of regex_search
+calls over line.substr(index), which rescanned the remaining suffix for every token.
+*/
+enum CharClass : unsigned char
+{
+    CC_OTHER,
+    CC_SPACE,
+    CC_LETTER,
+    CC_DIGIT,
+    CC_SYMBOL, // + - * / ( ) ;
+    CC_COLON   // only valid as the first half of :=
 };
 
+static constexpr array<unsigned char, 256> makeCharClassTable()
+{
+    array<unsigned char, 256> table{};
+    for (int c = 'a'; c <= 'z'; c++) table[c] = CC_LETTER;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] = CC_LETTER;
+    for (int c = '0'; c <= '9'; c++) table[c] = CC_DIGIT;
+    // same set as the \s class used by the old WHITESPACE_REGEX
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) table[(unsigned char)c] = CC_SPACE;
+    for (char c : {'+', '-', '*', '/', '(', ')', ';'}) table[(unsigned char)c] = CC_SYMBOL;
+    table[(unsigned char)':'] = CC_COLON;
+    return table;
+}
+
+static constexpr array<unsigned char, 256> CHAR_CLASS = makeCharClassTable();
+
+static constexpr array<TokenCode, 256> makeSymbolCodeTable()
+{
+    array<TokenCode, 256> table{};
+    table[(unsigned char)'+'] = TokenCode::PLUS;
+    table[(unsigned char)'-'] = TokenCode::MINUS;
+    table[(unsigned char)'*'] = TokenCode::TIMES;
+    table[(unsigned char)'/'] = TokenCode::DIVIDE;
+    table[(unsigned char)'('] = TokenCode::LPAREN;
+    table[(unsigned char)')'] = TokenCode::RPAREN;
+    table[(unsigned char)';'] = TokenCode::SEMICOLON;
+    return table;
+}
+
+static constexpr array<TokenCode, 256> SYMBOL_CODE = makeSymbolCodeTable();
+
+// Returns TokenCode::NONE when the word is not a keyword
+static TokenCode keywordCode(const char* text, size_t length)
+{
+    switch (length)
+    {
+    case 2:
+        if (memcmp(text, "if", 2) == 0) return TokenCode::IF;
+        if (memcmp(text, "do", 2) == 0) return TokenCode::DO;
+        break;
+    case 4:
+        if (memcmp(text, "then", 4) == 0) return TokenCode::THEN;
+        if (memcmp(text, "else", 4) == 0) return TokenCode::ELSE;
+        if (memcmp(text, "skip", 4) == 0) return TokenCode::SKIP;
+        break;
+    case 5:
+        if (memcmp(text, "endif", 5) == 0) return TokenCode::ENDIF;
+        if (memcmp(text, "while", 5) == 0) return TokenCode::WHILE;
+        break;
+    case 8:
+        if (memcmp(text, "endwhile", 8) == 0) return TokenCode::ENDWHILE;
+        break;
+    }
+    return TokenCode::NONE;
+}
+
+const char* tokenKindName(TokenKind kind)
+{
+    switch (kind)
+    {
+    case TokenKind::IDENTIFIER:
+        return "IDENTIFIER";
+    case TokenKind::NUMBER:
+        return "NUMBER";
+    case TokenKind::KEYWORD:
+        return "KEYWORD";
+    case TokenKind::SYMBOL:
+        return "SYMBOL";
+    case TokenKind::ERROR:
+        return "ERROR READING";
+    case TokenKind::END_OF_FILE:
+        return "End of File";
+    }
+    return "";
+}
+
 bool isOnlyWhiteSpace(const string& line)
 {
     return all_of(line.begin(), line.end(), [](char c) { return isspace(c); });
 }
 
-vector<Token> scanLine(const string& line)
+Token Scanner::next()
 {
-    vector<Token> tokens;
-    size_t index = 0;
-
-    while (index < line.length())
+    const char* text = source.data();
+    size_t length = source.size();
+    while (index < length)
     {
-        string token;
-        string remaining = line.substr(index);
-        smatch match;
-        if (regex_search(remaining, match, WHITESPACE_REGEX) && match.position() == 0)
+        size_t start = index;
+        uint32_t column = (uint32_t)(start - lineStart + 1);
+        switch (CHAR_CLASS[(unsigned char)text[index]])
         {
-            index += match.length();
+        case CC_SPACE:
+            while (index < length && CHAR_CLASS[(unsigned char)text[index]] == CC_SPACE)
+            {
+                if (text[index] == '\n')
+                {
+                    lineNumber++;
+                    lineStart = index + 1;
+                }
+                index++;
+            }
             continue;
-        }
-        else if (regex_search(remaining, match, KEYWORD_REGEX) && match.position() == 0)
+        case CC_LETTER:
         {
-            token = match.str();
-            tokens.push_back({"KEYWORD", token});
+            while (index < length && (CHAR_CLASS[(unsigned char)text[index]] == CC_LETTER
+                                      || CHAR_CLASS[(unsigned char)text[index]] == CC_DIGIT))
+            {
+                index++;
+            }
+            /*
+            keywords used to be matched with \b(...)\b, and '_' counts as a word
+            character for \b, so "skip_" scans as the identifier "skip" followed by an error
+            */
+            TokenCode code = keywordCode(text + start, index - start);
+            if (code != TokenCode::NONE && (index == length || text[index] != '_'))
+            {
+                return {TokenKind::KEYWORD, code, string_view(text + start, index - start), lineNumber, column};
+            }
+            return {TokenKind::IDENTIFIER, TokenCode::NONE, string_view(text + start, index - start), lineNumber, column};
         }
-        else if (regex_search(remaining, match, IDENTIFIER_REGEX) && match.position() == 0)
-        {
-            token = match.str();
-            tokens.push_back({"IDENTIFIER", token});
+        case CC_DIGIT:
+            while (index < length && CHAR_CLASS[(unsigned char)text[index]] == CC_DIGIT)
+            {
+                index++;
+            }
+            return {TokenKind::NUMBER, TokenCode::NONE, string_view(text + start, index - start), lineNumber, column};
+        case CC_SYMBOL:
+            index++;
+            return {TokenKind::SYMBOL, SYMBOL_CODE[(unsigned char)text[start]], string_view(text + start, 1), lineNumber, column};
+        case CC_COLON:
+            if (index + 1 < length && text[index + 1] == '=')
+            {
+                index += 2;
+                return {TokenKind::SYMBOL, TokenCode::ASSIGN, string_view(text + start, 2), lineNumber, column};
+            }
+            break;
+        default:
+            break;
         }
-        else if (regex_search(remaining, match, NUMBER_REGEX) && match.position() == 0)
+
+        // the rest of the line is not scanned, the next token is on a later line
+        index = min(source.find('\n', start), length);
+        return {TokenKind::ERROR, TokenCode::NONE, string_view(text + start, 1), lineNumber, column};
+    }
+    return {TokenKind::END_OF_FILE, TokenCode::NONE, ""};
+}
+
+vector<Token> scanLine(const string& line)
+{
+    vector<Token> tokens;
+    Scanner scanner(line);
+    for (Token token = scanner.next(); token.kind != TokenKind::END_OF_FILE; token = scanner.next())
+    {
+        tokens.push_back(token);
+        if (token.kind == TokenKind::ERROR)
         {
-            token = match.str();
-            tokens.push_back({"NUMBER", token});
+            break;
         }
-        else if (regex_search(remaining, match, SYMBOL_REGEX) && match.position() == 0)
+    }
+    return tokens;
+}
+
+FileBytes::FileBytes(const string& path)
+{
+#if LIMP_SCANNER_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return;
+    }
+    if ((size_t)info.st_size >= MAP_THRESHOLD)
+    {
+#ifdef MAP_POPULATE
+        int flags = MAP_PRIVATE | MAP_POPULATE;
+#else
+        int flags = MAP_PRIVATE;
+#endif
+        void* pages = mmap(nullptr, (size_t)info.st_size, PROT_READ, flags, fd, 0);
+        if (pages != MAP_FAILED)
         {
-            token = match.str();
-            tokens.push_back({"SYMBOL", token});
+            data = (const char*)pages;
+            size = (size_t)info.st_size;
+            mapped = true;
         }
-        else
+    }
+    else
+    {
+        buffer.resize((size_t)info.st_size);
+        if (read(fd, &buffer[0], buffer.size()) == (ssize_t)buffer.size())
         {
-            string error(1, line[index]);
-            tokens.push_back({"ERROR READING", error});
-            break;
+            data = buffer.data();
+            size = buffer.size();
         }
-        /*
-        when nothing matches, the length of match is 0
-        ensure index always move forward
-        */
-        index += match.length() > 0 ? match.length() : 1;
     }
+    close(fd);
+#else
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+    {
+        return;
+    }
+    buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#endif
+}
 
-    return tokens;
-};
+FileBytes::~FileBytes()
+{
+#if LIMP_SCANNER_MMAP
+    if (mapped)
+    {
+        munmap((void*)data, size);
+    }
+#endif
+}
 
 /*
 int main(int argc, char *argv[])
@@ -118,13 +303,13 @@ int main(int argc, char *argv[])
 
         for (const Token &token : tokens)
         {
-            if (token.type == "ERROR READING")
+            if (token.kind == TokenKind::ERROR)
             {
-                outputFile << "ERROR READING: \"" + token.value + "\"" << endl;
+                outputFile << "ERROR READING: \"" << token.value << "\"" << endl;
             }
             else
             {
-                outputFile << token.value << ": " << token.type << endl;
+                outputFile << token.value << ": " << tokenKindName(token.kind) << endl;
             }
         }
 
@@ -2,15 +2,103 @@
 #define LIMP_SCANNER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
 
+enum class TokenKind : uint8_t {
+    IDENTIFIER,
+    NUMBER,
+    KEYWORD,
+    SYMBOL,
+    ERROR,       // printed as "ERROR READING"
+    END_OF_FILE  // returned by the Scanner and TokenStream past the last token
+};
+
+// Which keyword or symbol a token is, so the parser never compares strings
+enum class TokenCode : uint8_t {
+    NONE,
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE,
+    LPAREN,
+    RPAREN,
+    SEMICOLON,
+    ASSIGN,
+    IF,
+    THEN,
+    ELSE,
+    ENDIF,
+    WHILE,
+    DO,
+    ENDWHILE,
+    SKIP
+};
+
+/*
+A token does not own its text: value is a view into the source the Scanner reads (or
+the string passed to scanLine), which has to stay alive for as long as the tokens are used.
+line and column (both from 1) locate the token in that source, whose lines are
+separated by '\n'; the interpreter scans the whole program as one such source.
+*/
 struct Token {
-    std::string type;
-    std::string value;
+    TokenKind kind;
+    TokenCode code;
+    std::string_view value;
+    uint32_t line = 0;
+    uint32_t column = 0;
 };
 
+// The names used in the token dumps ("IDENTIFIER", "ERROR READING", ...)
+const char* tokenKindName(TokenKind kind);
+
 bool isOnlyWhiteSpace(const std::string& line);
 
+/*
+Scans a source one token at a time, as the parser asks for them (see TokenStream), so the
+tokens of a program are never all held at once. As when every line was scanned on its own,
+a character that starts no token is returned as an ERROR token and the scanner goes on with
+the next line.
+*/
+class Scanner {
+public:
+    explicit Scanner(std::string_view source) : source(source) {}
+
+    // The next token of the source, END_OF_FILE once there is none
+    Token next();
+
+private:
+    std::string_view source;
+    size_t index = 0;
+    uint32_t lineNumber = 1;
+    size_t lineStart = 0; // index of the first character of line lineNumber
+};
+
+// The tokens of line, up to and including the first ERROR token
 std::vector<Token> scanLine(const std::string& line);
 
-#endif 
\ No newline at end of file
+/*
+The bytes of a file. Large files are mapped into memory (with their pages read in at once where
+the system can); small ones are read, which takes fewer system calls than setting up a mapping.
+data is null when the file cannot be read.
+*/
+class FileBytes {
+public:
+    static const size_t MAP_THRESHOLD = 64 * 1024;
+
+    explicit FileBytes(const std::string& path);
+    ~FileBytes();
+
+    FileBytes(const FileBytes&) = delete;
+    FileBytes& operator=(const FileBytes&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+private:
+    std::string buffer;
+    bool mapped = false;
+};
+
+#endif 
@@ -0,0 +1,163 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Server for Limp
+Description: This module answers the requests to run Limp programs that arrive on a Unix-domain
+             socket (see Server.h). Programs are prepared once and kept, so a program that is
+             sent again is not scanned, parsed or compiled again; each run gets its own limits.
+*/
+
+#include "LimpServer.h"
+#include "LimpParser.h"
+#include "LimpBytecode.h"
+#include "LimpOptimizer.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// A program as the first request that sent it left it
+struct PreparedProgram
+{
+    string listing;    // the token list and the AST as the output file has them, up to a syntax error
+    string error;      // the syntax error, empty when the program parsed
+    AST ast;
+    Bytecode bytecode; // with LOOP_BUDGET instructions, every request runs with a budget
+};
+
+static shared_ptr<const PreparedProgram> prepare(string_view source, bool accelerateLoops, bool foldAST, bool reuseValues)
+{
+    auto program = make_shared<PreparedProgram>();
+    ostringstream listing;
+    listing << "Tokens: \n";
+
+    // one pass, as the interpreter scans and parses a file (see LimpInterpreter.cpp)
+    Scanner scanner(source);
+    TokenStream ts(scanner, [&](const Token &token)
+    {
+        if (token.kind == TokenKind::ERROR)
+        {
+            listing << "ERROR READING: \"" << token.value << "\"\n";
+        }
+        else
+        {
+            listing << token.value << ": " << tokenKindName(token.kind) << "\n";
+        }
+    });
+    try
+    {
+        program->ast.root = parseStatement(ts, program->ast);
+        if (ts.peek().kind != TokenKind::END_OF_FILE)
+        {
+            program->error = "ERROR IN PARSER: Unexpected token: \"" + string(ts.peek().value) + "\" after expression\n\n";
+        }
+    }
+    catch (const ParseError &e)
+    {
+        program->error = string(e.what()) + "\n";
+    }
+    ts.finish();
+    if (!program->error.empty())
+    {
+        program->listing = listing.str();
+        return program;
+    }
+
+    listing << "\nAST:\n";
+    printAST(program->ast, program->ast.root, listing);
+    listing << "\n";
+    program->listing = listing.str();
+    if (foldAST)
+    {
+        foldConstants(program->ast);
+    }
+    program->bytecode = compileProgram(program->ast, accelerateLoops, ProfileMode::OFF, true, reuseValues);
+    return program;
+}
+
+// The part of the output file after the AST, and the status of the response
+static string run(const PreparedProgram &program, const ExecutionLimits &limits, const char *&status)
+{
+    ExecutionBudget budget(limits);
+    VirtualMachine vm(program.bytecode, nullptr, &budget);
+    vm.reportLoops = false;
+    ostringstream out;
+    try
+    {
+        vm.run();
+        status = "ok";
+        out << "Output:\n";
+    }
+    catch (const BudgetExceeded &e)
+    {
+        status = "limit";
+        out << "Execution stopped: " << e.what() << stoppedWhere(e, program.ast) << "\nPartial output:\n";
+    }
+    catch (const exception &e)
+    {
+        status = "error";
+        return "Evaluation Error: " + string(e.what()) + "\n";
+    }
+    for (const auto &[var, val] : vm.getMemory())
+    {
+        out << var << " = " << val << "\n";
+    }
+    return out.str();
+}
+
+// The lower of two limits, where 0 is no limit
+template <class T>
+static T lowerLimit(T server, T request)
+{
+    return request > 0 && (server == 0 || request < server) ? request : server;
+}
+
+int serveLimp(const ServerOptions &options, ExecutionLimits limits, bool accelerateLoops, bool foldAST, bool reuseValues)
+{
+    if (limits.seconds <= 0)
+    {
+        limits.seconds = DEFAULT_SERVER_TIME_LIMIT;
+    }
+    ProgramCache<PreparedProgram> cache(options.cacheEntries);
+    int status = serveUnixSocket(options, [&](const string &payload)
+    {
+        ServerRequest request;
+        string error;
+        if (!parseServerRequest(payload, request, error))
+        {
+            return serverResponse("rejected", error + "\n");
+        }
+        if (request.language != "limp")
+        {
+            return serverResponse("rejected", "This server runs Limp programs\n");
+        }
+
+        shared_ptr<const PreparedProgram> program = cache.find(request.source);
+        if (!program)
+        {
+            program = prepare(request.source, accelerateLoops, foldAST, reuseValues);
+            cache.insert(request.source, program);
+        }
+        if (!program->error.empty())
+        {
+            return serverResponse("error", request.full ? program->listing + program->error : program->error);
+        }
+
+        ExecutionLimits requestLimits;
+        requestLimits.fuel = lowerLimit(limits.fuel, request.fuel);
+        requestLimits.seconds = lowerLimit(limits.seconds, request.seconds);
+        requestLimits.memoryBytes = lowerLimit(limits.memoryBytes, (size_t)(request.memoryMB * 1024 * 1024));
+        const char *outcome;
+        string result = run(*program, requestLimits, outcome);
+        return serverResponse(outcome, request.full ? program->listing + result : result);
+    });
+    if (status == 0)
+    {
+        cerr << "Program cache: " << cache.hitCount() << " hits, " << cache.missCount() << " misses" << endl;
+    }
+    return status;
+}
@@ -0,0 +1,22 @@
+#ifndef LIMP_SERVER_H
+#define LIMP_SERVER_H
+
+#include "LimpBudget.h"
+#include "Server.h"
+
+using namespace std;
+
+// The time limit of every request when the server is started without --time-limit
+const double DEFAULT_SERVER_TIME_LIMIT = 10;
+
+/*
+Runs LimpInterpreter --serve (see Server.h) until it is interrupted. A program is scanned, parsed
+and compiled the first time it is sent: its token list and AST, printed as the output file has
+them, and its bytecode are kept in a ProgramCache, so the same source sent again only runs.
+Every request runs on a VirtualMachine of its own, within limits lowered by those of the request;
+a server is never without a time limit, so one endless loop cannot keep a worker forever.
+accelerateLoops, foldAST and reuseValues are the interpreter's --no-accel, --fold and --cse.
+*/
+int serveLimp(const ServerOptions &options, ExecutionLimits limits, bool accelerateLoops, bool foldAST, bool reuseValues);
+
+#endif
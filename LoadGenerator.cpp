@@ -0,0 +1,159 @@
+/*
+Name: Hoang Mai Han Dang, Yazi Zhang
+Phase: Load generator for the interpreter servers
+Description: This program sends requests to a LimpInterpreter or LexpInterpreter running with
+             --serve=SOCKET (see Server.h) from several connections at once, each sending its
+             next request as soon as the previous one is answered, and measures the requests
+             answered per second and the latency of the requests (median and tail).
+             The results are printed as JSON (see BenchmarkReport.h); --compare=FILE compares
+             them with an earlier run and exits with 1 when one got worse than --threshold.
+*/
+
+#include "Server.h"
+#include "BenchmarkReport.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    string socketPath;
+    string language = "limp";
+    string header;
+    unsigned connections = 4;
+    uint64_t requests = 10000;
+    BenchmarkOptions options;
+    vector<string> programPaths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0) {
+            socketPath = arg.substr(strlen("--socket="));
+        } else if (arg.rfind("--language=", 0) == 0) {
+            language = arg.substr(strlen("--language="));
+        } else if (arg == "--full") {
+            header += " full";
+        } else if (arg.rfind("--fuel=", 0) == 0 || arg.rfind("--time-limit=", 0) == 0 || arg.rfind("--memory-limit=", 0) == 0) {
+            header += " " + arg.substr(2); // passed on in the header of every request
+        } else if (arg.rfind("--connections=", 0) == 0) {
+            connections = max(1, atoi(arg.c_str() + strlen("--connections=")));
+        } else if (arg.rfind("--requests=", 0) == 0) {
+            requests = strtoull(arg.c_str() + strlen("--requests="), nullptr, 10);
+        } else if (arg.rfind("--compare=", 0) == 0) {
+            options.compareWith = arg.substr(strlen("--compare="));
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            options.threshold = atof(arg.c_str() + strlen("--threshold="));
+        } else if (arg.rfind("--", 0) == 0 || arg.empty()) {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        } else {
+            programPaths.push_back(arg);
+        }
+    }
+    if (socketPath.empty() || programPaths.empty()) {
+        cout << "Usage: ./LoadGenerator --socket=SOCKET [--language=limp|lexp] [--full] [--connections=N] [--requests=N] [--fuel=N] [--time-limit=SECONDS] [--memory-limit=MB] [--compare=previous.json] [--threshold=PERCENT] <program_file>..." << endl;
+        return 1;
+    }
+
+    // the requests go round the programs, so several files make a mix
+    vector<string> payloads;
+    for (const string& path : programPaths) {
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) {
+            cerr << "Cannot open " << path << endl;
+            return 1;
+        }
+        ostringstream source;
+        source << file.rdbuf();
+        payloads.push_back(language + header + "\n" + source.str());
+    }
+
+    atomic<uint64_t> next{0};
+    mutex guard;
+    vector<double> latencies; // microseconds, of every request answered
+    map<string, uint64_t> statuses;
+    uint64_t broken = 0;
+
+    auto client = [&]() {
+        int fd = connectUnixSocket(socketPath);
+        if (fd < 0) {
+            lock_guard<mutex> lock(guard);
+            broken++;
+            return;
+        }
+        vector<double> mine;
+        map<string, uint64_t> seen;
+        string response;
+        bool open = true;
+        while (open) {
+            uint64_t i = next++;
+            if (i >= requests) {
+                break;
+            }
+            auto start = chrono::steady_clock::now();
+            open = writeFrame(fd, payloads[i % payloads.size()]) && readFrame(fd, response);
+            chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+            if (open) {
+                mine.push_back(elapsed.count());
+                seen[response.substr(0, response.find('\n'))]++;
+            }
+        }
+        close(fd);
+        lock_guard<mutex> lock(guard);
+        latencies.insert(latencies.end(), mine.begin(), mine.end());
+        for (const auto& [status, count] : seen) {
+            statuses[status] += count;
+        }
+        broken += !open;
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (unsigned i = 0; i < connections; i++) {
+        clients.emplace_back(client);
+    }
+    for (thread& t : clients) {
+        t.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    for (const auto& [status, count] : statuses) {
+        cerr << count << " requests answered " << status << endl;
+    }
+    if (broken > 0) {
+        cerr << broken << " connections failed or were closed by the server" << endl;
+    }
+    if (latencies.empty()) {
+        cerr << "No request was answered" << endl;
+        return 1;
+    }
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction) {
+        return latencies[min(latencies.size() - 1, (size_t)(fraction * latencies.size()))];
+    };
+    BenchmarkReport report("server", 1.0);
+    string workload = language + "/" + to_string(connections) + "_connections";
+    report.add(workload + "/throughput", latencies.size() / elapsed.count(), "requests/s", false);
+    report.add(workload + "/latency_p50", percentile(0.50), "us", true);
+    report.add(workload + "/latency_p90", percentile(0.90), "us", true);
+    report.add(workload + "/latency_p99", percentile(0.99), "us", true);
+    report.add(workload + "/latency_p999", percentile(0.999), "us", true);
+    report.add(workload + "/latency_max", latencies.back(), "us", true);
+
+    report.writeJson(cout);
+    if (!options.compareWith.empty()) {
+        return report.compare(options.compareWith, options.threshold, cerr) > 0 ? 1 : 0;
+    }
+    return broken > 0 ? 1 : 0;
+}
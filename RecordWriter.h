@@ -0,0 +1,219 @@
+#ifndef RECORD_WRITER_H
+#define RECORD_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <charconv>
+#include <cstdint>
+
+using namespace std;
+
+/*
+The output formats of LexpInterpreter and LimpInterpreter (--format=text|jsonl|binary). The text
+format is the one described in the READMEs and stays the default. The other two are for programs
+that read the output: they hold the same tokens, AST lines, results, final values and errors as
+the text, one record each, so nothing has to be parsed out of the text. Header only, like Trace.h,
+as the two interpreters share it.
+
+JSON Lines: one JSON object per line, with "type" first:
+    {"type":"token","kind":"NUMBER","text":"138"}
+    {"type":"ast","depth":1,"kind":"SYMBOL","text":"+"}     one per line of the text AST, in the same order
+    {"type":"result","value":10076}                         Lexp
+    {"type":"variable","name":"x","value":5}                Limp, in the order of the text output
+    {"type":"stopped","message":"Execution stopped: ..."}   Limp, the values after it are partial
+    {"type":"error","message":"Evaluation Error: Division by zero"}
+kind is the name the text uses for the token or the node, text its spelling, which is empty for the
+if and while nodes of Limp. A message is the line the text has for it. Bytes of the source that are
+not printable ASCII are written as \u00XX, one per byte.
+
+Binary: the 8 bytes "LEXP" or "LIMP", a version byte (BINARY_VERSION) and 3 zero bytes, then the
+records, each a type byte (RecordType), the length of the rest of the record as a 32-bit unsigned
+integer and that rest:
+    TOKEN     the TokenKind of the scanner (1 byte), the text
+    AST       the depth (32 bits), the NodeKind of the parser (1 byte), the text
+    RESULT    the value (32-bit signed)
+    VARIABLE  the value (32-bit signed), the name
+    STOPPED   the message
+    ERROR     the message
+Integers are little-endian, the enums those of the language's LexpScanner.h / LimpParser.h and so
+on. A Limp block is printed as a chain of ';' lines, which are AST records of kind SEQUENCE.
+
+In both formats every Lexp line that is not blank ends with exactly one result or error record.
+*/
+
+enum class OutputFormat : uint8_t {
+    TEXT,
+    JSON_LINES,
+    BINARY
+};
+
+// "text", "jsonl" or "binary"; false for anything else
+inline bool parseOutputFormat(string_view name, OutputFormat& format) {
+    if (name == "text") {
+        format = OutputFormat::TEXT;
+    } else if (name == "jsonl") {
+        format = OutputFormat::JSON_LINES;
+    } else if (name == "binary") {
+        format = OutputFormat::BINARY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+enum class RecordType : uint8_t {
+    TOKEN = 1,
+    AST = 2,
+    RESULT = 3,
+    VARIABLE = 4,
+    STOPPED = 5,
+    ERROR = 6
+};
+
+const uint8_t BINARY_VERSION = 1;
+
+// The 8 bytes a binary output starts with; language is "LEXP" or "LIMP"
+inline string binaryHeader(const char* language) {
+    string header(language, 4);
+    header += (char)BINARY_VERSION;
+    header.append(3, '\0');
+    return header;
+}
+
+/*
+Writes records in one of the two record formats into the buffer of out. Records go straight into
+the stream's buffer, which is only written out when it is full (the writer never flushes), so a
+writer costs nothing to make and one can be made for every line.
+*/
+class RecordWriter {
+    public:
+        RecordWriter(ostream& stream, OutputFormat format) : out(*stream.rdbuf()), binary(format == OutputFormat::BINARY) {}
+
+        void token(uint8_t kind, string_view kindName, string_view text) {
+            if (binary) {
+                start(RecordType::TOKEN, 1 + text.size());
+                putByte(kind);
+                put(text);
+            } else {
+                put("{\"type\":\"token\",\"kind\":");
+                putString(kindName);
+                put(",\"text\":");
+                putString(text);
+                put("}\n");
+            }
+        }
+
+        void astNode(uint32_t depth, uint8_t kind, string_view kindName, string_view text) {
+            if (binary) {
+                start(RecordType::AST, 4 + 1 + text.size());
+                putUint32(depth);
+                putByte(kind);
+                put(text);
+            } else {
+                put("{\"type\":\"ast\",\"depth\":");
+                putNumber(depth);
+                put(",\"kind\":");
+                putString(kindName);
+                put(",\"text\":");
+                putString(text);
+                put("}\n");
+            }
+        }
+
+        void result(int32_t value) {
+            if (binary) {
+                start(RecordType::RESULT, 4);
+                putUint32((uint32_t)value);
+            } else {
+                put("{\"type\":\"result\",\"value\":");
+                putNumber(value);
+                put("}\n");
+            }
+        }
+
+        void variable(string_view name, int32_t value) {
+            if (binary) {
+                start(RecordType::VARIABLE, 4 + name.size());
+                putUint32((uint32_t)value);
+                put(name);
+            } else {
+                put("{\"type\":\"variable\",\"name\":");
+                putString(name);
+                put(",\"value\":");
+                putNumber(value);
+                put("}\n");
+            }
+        }
+
+        void stopped(string_view message) { messageRecord(RecordType::STOPPED, "stopped", message); }
+
+        // message is the line of the text output, without its '\n's
+        void error(string_view message) { messageRecord(RecordType::ERROR, "error", message); }
+
+    private:
+        streambuf& out;
+        bool binary;
+
+        void put(string_view text) { out.sputn(text.data(), (streamsize)text.size()); }
+
+        void putByte(uint8_t byte) { out.sputc((char)byte); }
+
+        void putUint32(uint32_t value) {
+            const char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+            put(string_view(bytes, 4));
+        }
+
+        template <class Integer>
+        void putNumber(Integer value) {
+            char digits[16];
+            put(string_view(digits, (size_t)(to_chars(digits, digits + sizeof(digits), value).ptr - digits)));
+        }
+
+        void start(RecordType type, size_t length) {
+            putByte((uint8_t)type);
+            putUint32((uint32_t)length);
+        }
+
+        // A JSON string; runs of characters that need no escape are written at once
+        void putString(string_view text) {
+            static const char hex[] = "0123456789abcdef";
+            out.sputc('"');
+            size_t plain = 0;
+            for (size_t i = 0; i < text.size(); i++) {
+                unsigned char c = (unsigned char)text[i];
+                if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+                    continue;
+                }
+                put(text.substr(plain, i - plain));
+                if (c == '"' || c == '\\') {
+                    const char escaped[2] = {'\\', (char)c};
+                    put(string_view(escaped, 2));
+                } else {
+                    const char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    put(string_view(escaped, 6));
+                }
+                plain = i + 1;
+            }
+            put(text.substr(plain));
+            out.sputc('"');
+        }
+
+        void messageRecord(RecordType type, const char* typeName, string_view message) {
+            while (!message.empty() && message.back() == '\n') {
+                message.remove_suffix(1);
+            }
+            if (binary) {
+                start(type, message.size());
+                put(message);
+            } else {
+                put("{\"type\":\"");
+                put(typeName);
+                put("\",\"message\":");
+                putString(message);
+                put("}\n");
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,448 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+The server mode of LexpInterpreter and LimpInterpreter (--serve=SOCKET): a long-running
+interpreter that answers requests on a Unix-domain socket, so a caller pays for starting a
+process and writing files once instead of once per program. Header only, like Trace.h, as the
+two interpreters share it; they cannot be linked into one program, so each serves its own language.
+
+Every message is a frame: its length in 4 bytes, little-endian, followed by that many bytes.
+A request is a header line and then the program source:
+
+    limp full fuel=1000000 time-limit=2 memory-limit=64
+    x := 1; while 10 - x do x := x + 1 endwhile
+
+The header names the language and may go on with "full", to be answered with everything the
+output file would hold (tokens, AST and result) instead of only the part after the AST, and with
+limits for this request (Limp only), which can lower the server's own limits but not raise them.
+A response is a status line ("ok", "error", "limit" or "rejected") and then the text of the answer.
+A connection can send any number of requests, each after the response to the one before.
+*/
+
+// Frames longer than this are refused, the connection is closed
+const uint32_t MAX_FRAME_BYTES = 64 << 20;
+
+// A connection that stalls halfway through a frame is dropped after this long
+const int FRAME_TIMEOUT_SECONDS = 5;
+
+// Connections beyond this many are closed as soon as they are accepted
+const size_t MAX_CONNECTIONS = 1024;
+
+inline bool readFully(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n > 0) {
+            data += n;
+            size -= (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return false; // closed by the peer, timed out or failed
+        }
+    }
+    return true;
+}
+
+inline bool writeFully(int fd, const char* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // a peer that went away is an error here, not a SIGPIPE
+#else
+    const int flags = 0;
+#endif
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, flags);
+        if (n > 0) {
+            data += n;
+            size -= (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false when the connection ended (or broke) instead of sending a whole frame
+inline bool readFrame(int fd, string& payload) {
+    unsigned char length[4];
+    if (!readFully(fd, (char*)length, sizeof(length))) {
+        return false;
+    }
+    uint32_t size = length[0] | (uint32_t)length[1] << 8 | (uint32_t)length[2] << 16 | (uint32_t)length[3] << 24;
+    if (size > MAX_FRAME_BYTES) {
+        return false;
+    }
+    payload.resize(size);
+    return readFully(fd, &payload[0], size);
+}
+
+inline bool writeFrame(int fd, string_view payload) {
+    uint32_t size = (uint32_t)payload.size();
+    char length[4] = {(char)(size & 0xff), (char)(size >> 8 & 0xff), (char)(size >> 16 & 0xff), (char)(size >> 24)};
+    return writeFully(fd, length, sizeof(length)) && writeFully(fd, payload.data(), payload.size());
+}
+
+struct ServerRequest {
+    string language;     // "limp" or "lexp"
+    bool full = false;   // answer with the tokens and the AST too
+    uint64_t fuel = 0;   // the limits of this request, 0 where it sets none (see ExecutionLimits)
+    double seconds = 0;
+    double memoryMB = 0;
+    string_view source;  // the rest of the payload, after the header line
+};
+
+// Reads the header line of payload into request; returns false with the reason in error
+inline bool parseServerRequest(const string& payload, ServerRequest& request, string& error) {
+    size_t headerEnd = payload.find('\n');
+    string_view header(payload.data(), headerEnd == string::npos ? payload.size() : headerEnd);
+    request.source = headerEnd == string::npos ? string_view() : string_view(payload).substr(headerEnd + 1);
+    size_t at = 0;
+    while (at < header.size()) {
+        size_t end = header.find(' ', at);
+        string word(header.substr(at, end == string_view::npos ? string_view::npos : end - at));
+        at = end == string_view::npos ? header.size() : end + 1;
+        if (word.empty() || word == "\r") {
+            continue;
+        }
+        if (request.language.empty()) {
+            request.language = word;
+        } else if (word == "full") {
+            request.full = true;
+        } else if (word.rfind("fuel=", 0) == 0) {
+            request.fuel = strtoull(word.c_str() + strlen("fuel="), nullptr, 10);
+        } else if (word.rfind("time-limit=", 0) == 0) {
+            request.seconds = atof(word.c_str() + strlen("time-limit="));
+        } else if (word.rfind("memory-limit=", 0) == 0) {
+            request.memoryMB = atof(word.c_str() + strlen("memory-limit="));
+        } else {
+            error = "Unknown request option: " + word;
+            return false;
+        }
+    }
+    if (request.language.empty()) {
+        error = "The request names no language";
+        return false;
+    }
+    return true;
+}
+
+inline string serverResponse(const char* status, string_view body) {
+    string response = status;
+    response += '\n';
+    response += body;
+    return response;
+}
+
+/*
+The programs a server has prepared (scanned, parsed and compiled), so a source sent again is not
+prepared again. Keyed by a hash of the source, which is kept to tell two sources with the same
+hash apart; when full, the program used longest ago is dropped. Safe to use from several threads.
+*/
+template <class Program>
+class ProgramCache {
+    public:
+        explicit ProgramCache(size_t capacity) : capacity(capacity) {}
+
+        shared_ptr<const Program> find(string_view source) {
+            size_t key = hash<string_view>()(source);
+            lock_guard<mutex> lock(guard);
+            auto found = index.find(key);
+            if (found == index.end() || found->second->source != source) {
+                misses++;
+                return nullptr;
+            }
+            entries.splice(entries.begin(), entries, found->second);
+            hits++;
+            return found->second->program;
+        }
+
+        void insert(string_view source, shared_ptr<const Program> program) {
+            if (capacity == 0) {
+                return;
+            }
+            size_t key = hash<string_view>()(source);
+            lock_guard<mutex> lock(guard);
+            auto found = index.find(key);
+            if (found != index.end()) {
+                entries.erase(found->second);
+            }
+            entries.push_front(Entry{key, string(source), std::move(program)});
+            index[key] = entries.begin();
+            if (entries.size() > capacity) {
+                index.erase(entries.back().key);
+                entries.pop_back();
+            }
+        }
+
+        size_t hitCount() const { lock_guard<mutex> lock(guard); return hits; }
+        size_t missCount() const { lock_guard<mutex> lock(guard); return misses; }
+
+    private:
+        struct Entry {
+            size_t key;
+            string source;
+            shared_ptr<const Program> program;
+        };
+
+        size_t capacity;
+        mutable mutex guard;
+        list<Entry> entries; // the most recently used first
+        unordered_map<size_t, typename list<Entry>::iterator> index;
+        size_t hits = 0;
+        size_t misses = 0;
+};
+
+struct ServerOptions {
+    string socketPath;
+    unsigned workers = max(1u, thread::hardware_concurrency());
+    size_t cacheEntries = 1024; // programs kept prepared (see ProgramCache)
+};
+
+// Set by SIGINT and SIGTERM while a server runs, which also wake it through the pipe serverWakeFd writes to
+inline volatile sig_atomic_t serverStopRequested = 0;
+inline int serverWakeFd = -1;
+
+inline void stopServerOnSignal(int) {
+    serverStopRequested = 1;
+    char byte = 0;
+    ssize_t ignored = write(serverWakeFd, &byte, 1);
+    (void)ignored;
+}
+
+/*
+Listens on options.socketPath until the process gets SIGINT or SIGTERM, and answers every
+request with what handle returns for its payload, from a pool of options.workers threads.
+The calling thread polls the listening socket and the connections that wait for their next
+request; a connection whose request has arrived is queued for the workers, and comes back to
+the poll set once it is answered, so the threads do not grow with the connections.
+handle is called from several threads at once. Returns the exit status.
+*/
+inline int serveUnixSocket(const ServerOptions& options, const function<string(const string& request)>& handle) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.empty() || options.socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "The socket path must have 1 to " << sizeof(address.sun_path) - 1 << " characters" << endl;
+        return 1;
+    }
+    memcpy(address.sun_path, options.socketPath.c_str(), options.socketPath.size());
+
+    // a socket left behind by a server that is gone is replaced, a live one or any other file is not
+    struct stat existing;
+    if (lstat(options.socketPath.c_str(), &existing) == 0) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (!S_ISSOCK(existing.st_mode) || live) {
+            cerr << options.socketPath << " is in use" << endl;
+            return 1;
+        }
+        unlink(options.socketPath.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        cerr << "Cannot listen on " << options.socketPath << ": " << strerror(errno) << endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+    // woken by the signal handler and by workers handing a connection back
+    int wake[2];
+    if (pipe(wake) != 0) {
+        cerr << "Cannot create a pipe: " << strerror(errno) << endl;
+        close(listener);
+        unlink(options.socketPath.c_str());
+        return 1;
+    }
+    fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+    serverStopRequested = 0;
+    serverWakeFd = wake[1];
+    auto previousInterrupt = signal(SIGINT, stopServerOnSignal);
+    auto previousTerminate = signal(SIGTERM, stopServerOnSignal);
+    auto previousPipe = signal(SIGPIPE, SIG_IGN);
+
+    mutex guard;
+    condition_variable ready;
+    deque<int> waiting;       // connections with a request to read, for the workers
+    vector<int> answered;     // connections handed back by the workers, for the poll loop
+    bool stopping = false;
+    atomic<size_t> connections{0};
+    atomic<uint64_t> served{0};
+
+    auto worker = [&]() {
+        string request;
+        while (true) {
+            int connection;
+            {
+                unique_lock<mutex> lock(guard);
+                ready.wait(lock, [&]() { return stopping || !waiting.empty(); });
+                if (waiting.empty()) {
+                    return;
+                }
+                connection = waiting.front();
+                waiting.pop_front();
+            }
+            bool open = readFrame(connection, request);
+            if (open) {
+                string response;
+                try {
+                    response = handle(request);
+                } catch (const exception& e) {
+                    response = serverResponse("error", string(e.what()) + "\n");
+                }
+                served++;
+                open = writeFrame(connection, response);
+            }
+            if (!open) {
+                close(connection);
+                connections--;
+                continue;
+            }
+            lock_guard<mutex> lock(guard);
+            answered.push_back(connection);
+            char byte = 0;
+            ssize_t ignored = write(wake[1], &byte, 1);
+            (void)ignored;
+        }
+    };
+    vector<thread> workers;
+    for (unsigned i = 0; i < max(1u, options.workers); i++) {
+        workers.emplace_back(worker);
+    }
+    cerr << "Serving on " << options.socketPath << " with " << workers.size() << " workers" << endl;
+
+    vector<int> idle; // connections waiting for their next request
+    vector<pollfd> polled;
+    while (!serverStopRequested) {
+        polled.clear();
+        polled.push_back(pollfd{wake[0], POLLIN, 0});
+        polled.push_back(pollfd{listener, POLLIN, 0});
+        for (int connection : idle) {
+            polled.push_back(pollfd{connection, POLLIN, 0});
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "poll failed: " << strerror(errno) << endl;
+            break;
+        }
+
+        if (polled[0].revents) {
+            char drained[64];
+            while (read(wake[0], drained, sizeof(drained)) > 0) {
+            }
+        }
+        vector<int> stillIdle;
+        vector<int> requests;
+        for (size_t i = 2; i < polled.size(); i++) {
+            (polled[i].revents ? requests : stillIdle).push_back(polled[i].fd);
+        }
+        idle.swap(stillIdle);
+        {
+            lock_guard<mutex> lock(guard);
+            idle.insert(idle.end(), answered.begin(), answered.end());
+            answered.clear();
+            waiting.insert(waiting.end(), requests.begin(), requests.end());
+        }
+        // a closed connection is readable too; the worker finds nothing to read and closes it
+        if (!requests.empty()) {
+            ready.notify_all();
+        }
+
+        if (polled[1].revents) {
+            int connection;
+            while ((connection = accept(listener, nullptr, nullptr)) >= 0) {
+                if (connections >= MAX_CONNECTIONS) {
+                    close(connection);
+                    continue;
+                }
+                timeval timeout = {FRAME_TIMEOUT_SECONDS, 0};
+                setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                connections++;
+                idle.push_back(connection);
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(guard);
+        stopping = true; // the workers answer the requests already queued, then stop
+    }
+    ready.notify_all();
+    for (thread& t : workers) {
+        t.join();
+    }
+    for (int connection : idle) {
+        close(connection);
+    }
+    for (int connection : answered) {
+        close(connection);
+    }
+    close(listener);
+    unlink(options.socketPath.c_str());
+    signal(SIGINT, previousInterrupt);
+    signal(SIGTERM, previousTerminate);
+    signal(SIGPIPE, previousPipe);
+    serverWakeFd = -1;
+    close(wake[0]);
+    close(wake[1]);
+    cerr << "Served " << served << " requests" << endl;
+    return 0;
+}
+
+// A connection to the server listening on path, or -1 when there is none
+inline int connectUnixSocket(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <cstdint>
+
+using namespace std;
+
+/*
+Where the time of one run of LexpInterpreter or LimpInterpreter goes (--trace=FILE): a span per
+phase (scanning, parsing, printing the AST, evaluating, ...) on the monotonic clock, and counters
+(tokens scanned, nodes allocated, bytes written, evaluation steps) that grow as the run goes.
+The trace is written in the Chrome trace event format, which chrome://tracing, Perfetto and
+speedscope open. Header only, like BenchmarkReport.h, as the two interpreters share it.
+
+Every call takes a Trace pointer that is null when tracing is off, so an untraced run only pays
+for the null checks. Spans and counters may be recorded from several threads at once.
+*/
+
+class Trace {
+    public:
+        // At most this many events are kept; the ones after are counted in the file as dropped
+        static const size_t MAX_EVENTS = 1000000;
+
+        explicit Trace(const string& process) : process(process), start(chrono::steady_clock::now()) {}
+
+        // Microseconds since the trace started
+        double now() const {
+            chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+            return elapsed.count();
+        }
+
+        // A phase that ran from begin to now, with the numbers it reports in args
+        void complete(const char* name, double begin, const vector<pair<const char*, long long>>& args) {
+            double end = now();
+            lock_guard<mutex> lock(guard);
+            if (keep()) {
+                events.push_back(Event{name, 'X', begin, end - begin, threadId(), args});
+            }
+        }
+
+        // Adds amount to the counter name and records its new total
+        void count(const char* name, long long amount) {
+            double at = now();
+            lock_guard<mutex> lock(guard);
+            long long& total = totals[name];
+            total += amount;
+            if (keep()) {
+                events.push_back(Event{name, 'C', at, 0, threadId(), {{name, total}}});
+            }
+        }
+
+        // Returns false when path cannot be written
+        bool write(const string& path) {
+            ofstream out(path, ios::binary);
+            if (!out.is_open()) {
+                return false;
+            }
+            lock_guard<mutex> lock(guard);
+            out << "{\"traceEvents\":[\n";
+            out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"" << process << "\"}}";
+            out << fixed << setprecision(3);
+            for (const Event& e : events) {
+                out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << process << "\",\"ph\":\"" << e.phase
+                    << "\",\"ts\":" << e.timestamp;
+                if (e.phase == 'X') {
+                    out << ",\"dur\":" << e.duration;
+                }
+                out << ",\"pid\":1,\"tid\":" << e.thread << ",\"args\":{";
+                for (size_t i = 0; i < e.args.size(); i++) {
+                    out << (i > 0 ? "," : "") << "\"" << e.args[i].first << "\":" << e.args[i].second;
+                }
+                out << "}}";
+            }
+            out << "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+            return out.good();
+        }
+
+    private:
+        struct Event {
+            const char* name; // a string literal: names are plain identifiers and need no escaping
+            char phase;       // 'X' a complete span, 'C' a counter
+            double timestamp;
+            double duration;
+            uint32_t thread;
+            vector<pair<const char*, long long>> args;
+        };
+
+        string process;
+        chrono::steady_clock::time_point start;
+        mutex guard;
+        vector<Event> events;
+        map<string, long long> totals;
+        size_t dropped = 0;
+
+        bool keep() {
+            if (events.size() < MAX_EVENTS) {
+                return true;
+            }
+            dropped++;
+            return false;
+        }
+
+        // Small numbers for the threads, 1 for the first one to record something
+        static uint32_t threadId() {
+            static atomic<uint32_t> next{0};
+            thread_local uint32_t id = ++next;
+            return id;
+        }
+};
+
+/*
+Records the phase name from its construction to its end (or destruction) when trace is not null:
+
+    TraceSpan span(trace, "parse");
+    ...
+    span.arg("nodes", ast.nodes.size());
+*/
+class TraceSpan {
+    public:
+        TraceSpan(Trace* trace, const char* name) : trace(trace), name(name), begin(trace ? trace->now() : 0) {}
+        ~TraceSpan() { end(); }
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+        void arg(const char* key, long long value) {
+            if (trace) {
+                args.push_back({key, value});
+            }
+        }
+
+        void end() {
+            if (trace) {
+                trace->complete(name, begin, args);
+                trace = nullptr;
+            }
+        }
+
+    private:
+        Trace* trace;
+        const char* name;
+        double begin;
+        vector<pair<const char*, long long>> args;
+};
+
+// Adds amount to a counter of trace, if there is one
+inline void traceCount(Trace* trace, const char* name, long long amount) {
+    if (trace) {
+        trace->count(name, amount);
+    }
+}
+
+#endif